@@ -0,0 +1,352 @@
+// Copyright 2022 - Bang & Olufsen a/s
+// SPDX-License-Identifier: MIT
+
+#include <Yash.h>
+#include <YashServer.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+size_t s_allocations { 0 };
+size_t s_dispatches { 0 };
+size_t s_printCalls { 0 };
+size_t s_printBytes { 0 };
+
+void command(Yash::CommandArgs /* unused */)
+{
+    s_dispatches++;
+}
+
+/// @brief An output sink counting the output which can be inlined by the compiler
+struct CountingSink {
+    void operator()(const char* /* unused */, size_t size)
+    {
+        s_printCalls++;
+        s_printBytes += size;
+    }
+};
+
+/// @brief A sorted command table with names like "g001 c0042" generated at compile time
+template <size_t TGroups, size_t TCommandsPerGroup>
+struct CommandTable {
+    static constexpr size_t s_size { TGroups * TCommandsPerGroup };
+    static constexpr size_t s_nameSize { 10 };
+
+    static constexpr auto s_names = [] {
+        std::array<char, s_size * s_nameSize> names {};
+        for (size_t group = 0; group < TGroups; group++) {
+            for (size_t index = 0; index < TCommandsPerGroup; index++) {
+                char* name = names.data() + (group * TCommandsPerGroup + index) * s_nameSize;
+                name[0] = 'g';
+                name[1] = static_cast<char>('0' + group / 100 % 10);
+                name[2] = static_cast<char>('0' + group / 10 % 10);
+                name[3] = static_cast<char>('0' + group % 10);
+                name[4] = ' ';
+                name[5] = 'c';
+                name[6] = static_cast<char>('0' + index / 1000 % 10);
+                name[7] = static_cast<char>('0' + index / 100 % 10);
+                name[8] = static_cast<char>('0' + index / 10 % 10);
+                name[9] = static_cast<char>('0' + index % 10);
+            }
+        }
+        return names;
+    }();
+
+    static constexpr auto s_commands = [] {
+        std::array<Yash::Command, s_size> commands {};
+        for (size_t index = 0; index < s_size; index++)
+            commands[index] = { { s_names.data() + index * s_nameSize, s_nameSize }, "Benchmark command <a> <b> <c>", &command, 0 };
+        return commands;
+    }();
+
+    static_assert(Yash::isSorted(s_commands));
+};
+
+struct Scenario {
+    const char* name;
+    std::string_view setup; // Input set before measuring
+    std::string_view input; // Input set for each interaction
+    size_t iterations;
+    bool feed { false }; // The input is set by feed() instead of character by character
+};
+
+constexpr std::array<Scenario, 8> s_scenarios { {
+    { "typing", "", "g001 c0003 1 2 3\x03", 20000 },
+    { "feed", "", "g001 c0003 1 2 3\x03", 20000, true }, // The same input as typing set as a burst
+    { "dispatch", "", "g001 c0003 1 2 3\n", 20000 },
+    { "editing", "", "g001 c0003 1 2 3\033[1~x\033[3~\033[1;5C\033[1;5Cy\x7f\033[4~\x03", 20000 },
+    { "history", "g001 c0001\ng001 c0002\ng001 c0003\ng001 c0004\n", "\033[A\033[A\033[A\033[B\x03", 20000 },
+    { "tab-complete", "", "g001 \t\x03", 20000 },
+    { "tab-group", "", "g001 \t\t\t\x03", 2000 }, // Completes the common prefix and lists the candidates
+    { "tab-all", "", "\t\t\t\x03", 2000 },
+} };
+
+template <Yash::Config TConfig, typename TSink, typename TCommandTable>
+void run(const char* configName)
+{
+    for (const auto& scenario : s_scenarios) {
+        Yash::Yash<TConfig, TSink> yash(TCommandTable::s_commands);
+        if constexpr (std::is_same_v<TSink, Yash::FunctionSink>) {
+            yash.setPrint([](const char* text) {
+                s_printCalls++;
+                s_printBytes += std::strlen(text);
+            });
+        }
+
+        for (char character : scenario.setup)
+            yash.setCharacter(character);
+
+        s_allocations = s_dispatches = s_printCalls = s_printBytes = 0;
+        auto start = std::chrono::steady_clock::now();
+
+        for (size_t iteration = 0; iteration < scenario.iterations; iteration++) {
+            if (scenario.feed)
+                yash.feed(scenario.input);
+            else {
+                for (char character : scenario.input)
+                    yash.setCharacter(character);
+            }
+        }
+
+        std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+        double seconds = duration.count();
+        double iterations = static_cast<double>(scenario.iterations);
+
+        std::printf("{\"scenario\": \"%s\", \"config\": \"%s\", \"commands\": %zu, \"iterations\": %zu, "
+                    "\"keystrokes_per_second\": %.0f, \"dispatches_per_second\": %.0f, \"bytes_per_interaction\": %.1f, "
+                    "\"print_calls_per_interaction\": %.1f, \"allocations_per_interaction\": %.2f}\n",
+            scenario.name, configName, TCommandTable::s_size, scenario.iterations,
+            iterations * scenario.input.size() / seconds, s_dispatches / seconds, s_printBytes / iterations,
+            s_printCalls / iterations, s_allocations / iterations);
+    }
+}
+
+template <Yash::Config TConfig, typename TSink = Yash::FunctionSink>
+void run(const char* configName)
+{
+    run<TConfig, TSink, CommandTable<2, 5>>(configName);
+    run<TConfig, TSink, CommandTable<10, 10>>(configName);
+    run<TConfig, TSink, CommandTable<20, 50>>(configName);
+}
+
+/// @brief Prints the memory used per session of a session pool
+template <Yash::Config TConfig, typename TSink>
+void runSessions(const char* configName)
+{
+    static constexpr size_t sessions { 64 };
+    double sessionBytes = sizeof(Yash::SessionPool<TConfig, sessions, TSink>) / static_cast<double>(sessions);
+
+    std::printf("{\"scenario\": \"sessions\", \"config\": \"%s\", \"session_bytes\": %.0f, \"sessions_per_mb\": %.0f}\n",
+        configName, sessionBytes, 1024 * 1024 / sessionBytes);
+}
+
+/// @brief Compares formatting hex dump lines through the output of a shell with snprintf() and print()
+void runFormat()
+{
+    static constexpr Yash::Config config { .maxRequiredArgs = 3, .commandHistorySize = 0, .outputBufferSize = 256 };
+    static constexpr size_t lines { 200000 };
+    static constexpr size_t rounds { 5 }; // The fastest round is reported as the rounds are short
+    Yash::Yash<config, CountingSink> yash(CommandTable<2, 5>::s_commands);
+    Yash::Output output = yash.output();
+
+    auto measure = [&yash](const char* configName, auto&& formatLine) {
+        std::chrono::duration<double> duration { std::chrono::duration<double>::max() };
+        for (size_t round = 0; round < rounds; round++) {
+            s_allocations = s_printCalls = s_printBytes = 0;
+            auto start = std::chrono::steady_clock::now();
+
+            for (size_t line = 0; line < lines; line++)
+                formatLine(static_cast<uint32_t>(line * 8), static_cast<uint8_t>(line), static_cast<uint8_t>(line >> 8));
+            yash.flush();
+
+            duration = std::min<std::chrono::duration<double>>(duration, std::chrono::steady_clock::now() - start);
+        }
+
+        std::printf("{\"scenario\": \"format\", \"config\": \"%s\", \"lines_per_second\": %.0f, \"bytes_per_line\": %.1f, \"allocations_per_line\": %.2f}\n",
+            configName, lines / duration.count(), s_printBytes / static_cast<double>(lines), s_allocations / static_cast<double>(lines));
+    };
+
+    measure("output", [&output](uint32_t address, uint8_t low, uint8_t high) {
+        output.format("{:08x}: {:02x} {:02x} {:02x} {:02x}  {}\n", address, low, high, low ^ high, static_cast<uint8_t>(low + high), "dump");
+    });
+    measure("snprintf", [&yash](uint32_t address, uint8_t low, uint8_t high) {
+        char text[64];
+        std::snprintf(text, sizeof(text), "%08x: %02x %02x %02x %02x  %s\r\n", address, low, high, low ^ high, static_cast<uint8_t>(low + high), "dump");
+        yash.print(text);
+    });
+}
+
+/// @brief Compares running a script of commands with setting the same commands character by character
+void runScript()
+{
+    static constexpr Yash::Config config { .maxRequiredArgs = 3, .commandHistorySize = 10 };
+    static constexpr size_t lines { 100 };
+    static constexpr size_t iterations { 2000 };
+    static constexpr size_t rounds { 5 }; // The fastest round is reported as the rounds are short
+    static constexpr std::string_view line { "g001 c0003 1 2 3\n" };
+
+    std::array<char, lines * line.size()> script;
+    for (size_t index = 0; index < lines; index++)
+        std::copy(line.begin(), line.end(), script.begin() + index * line.size());
+
+    auto measure = [](const char* configName, auto&& runLines) {
+        Yash::Yash<config> yash(CommandTable<10, 10>::s_commands);
+        yash.setPrint([](const char* text) {
+            s_printCalls++;
+            s_printBytes += std::strlen(text);
+        });
+
+        std::chrono::duration<double> duration { std::chrono::duration<double>::max() };
+        for (size_t round = 0; round < rounds; round++) {
+            s_allocations = s_dispatches = s_printCalls = s_printBytes = 0;
+            auto start = std::chrono::steady_clock::now();
+
+            for (size_t iteration = 0; iteration < iterations; iteration++)
+                runLines(yash);
+
+            duration = std::min<std::chrono::duration<double>>(duration, std::chrono::steady_clock::now() - start);
+        }
+
+        double commands = static_cast<double>(lines * iterations);
+        std::printf("{\"scenario\": \"script\", \"config\": \"%s\", \"dispatches_per_second\": %.0f, \"bytes_per_command\": %.1f, "
+                    "\"print_calls_per_command\": %.1f, \"allocations_per_command\": %.2f}\n",
+            configName, commands / duration.count(), s_printBytes / commands, s_printCalls / commands, s_allocations / commands);
+    };
+
+    measure("characters", [&script](auto& yash) {
+        for (char character : script)
+            yash.setCharacter(character);
+    });
+    measure("script", [&script](auto& yash) { yash.runScript({ script.data(), script.size() }); });
+
+    // The script is tokenized in place so it is restored (as part of the measurement) before each run
+    std::array<char, script.size()> buffer;
+    measure("script-in-place", [&script, &buffer](auto& yash) {
+        buffer = script;
+        yash.runScriptInPlace(buffer);
+    });
+}
+
+/// @brief Compares running commands over a Linux socket pair in the RPC mode with the interactive mode
+///
+/// The host sends a batch of command lines (or request frames) which the shell handles, and then reads the
+/// output (and decodes the response frames).
+void runRpc()
+{
+    static constexpr Yash::Config config { .maxRequiredArgs = 3, .commandHistorySize = 10, .rpcFrameSize = 256, .txQueueSize = 256 };
+    static constexpr size_t batchSize { 32 };
+    static constexpr size_t batches { 5000 };
+    static constexpr std::string_view line { "g001 c0003 1 2 3" };
+
+    auto measure = [](const char* configName, bool rpc) {
+        int fds[2];
+        if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds))
+            return;
+
+        Yash::Yash<config, Yash::FileDescriptorSink> yash(CommandTable<10, 10>::s_commands, { fds[1] });
+        if (rpc)
+            yash.enterRpcMode();
+
+        std::array<char, batchSize * (line.size() + Yash::RpcFrame::s_overhead)> requests;
+        size_t requestsSize { 0 };
+        for (size_t index = 0; index < batchSize; index++) {
+            std::span<char> buffer { requests.data() + requestsSize, requests.size() - requestsSize };
+            if (rpc)
+                requestsSize += Yash::RpcFrame { static_cast<uint8_t>(index), 0, line }.encode(buffer);
+            else {
+                std::copy(line.begin(), line.end(), buffer.begin());
+                buffer[line.size()] = '\n';
+                requestsSize += line.size() + 1;
+            }
+        }
+
+        Yash::RpcDecoder<config.rpcFrameSize> decoder;
+        std::array<char, 4096> data;
+        size_t responses { 0 };
+        size_t bytes { 0 };
+        s_dispatches = 0;
+        auto start = std::chrono::steady_clock::now();
+
+        for (size_t batch = 0; batch < batches; batch++) {
+            ::send(fds[0], requests.data(), requestsSize, 0);
+            for (size_t received = 0; received < requestsSize;) {
+                ssize_t size = ::read(fds[1], data.data(), data.size());
+                if (size <= 0)
+                    break;
+
+                yash.feed({ data.data(), static_cast<size_t>(size) });
+                received += static_cast<size_t>(size);
+            }
+
+            for (ssize_t size; (size = ::recv(fds[0], data.data(), data.size(), MSG_DONTWAIT)) > 0;) {
+                bytes += static_cast<size_t>(size);
+                if (!rpc)
+                    continue;
+
+                for (char character : std::string_view { data.data(), static_cast<size_t>(size) }) {
+                    if (decoder.push(character) == Yash::RpcDecoder<config.rpcFrameSize>::Result::Frame && decoder.frame().status != Yash::RpcOutput)
+                        responses++;
+                }
+            }
+        }
+
+        std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+        double commands = static_cast<double>(batchSize * batches);
+        std::printf("{\"scenario\": \"rpc\", \"config\": \"%s\", \"commands_per_second\": %.0f, \"bytes_per_command\": %.1f, \"responses\": %zu}\n",
+            configName, s_dispatches / duration.count(), bytes / commands, responses);
+
+        ::close(fds[0]);
+        ::close(fds[1]);
+    };
+
+    measure("interactive", false);
+    measure("rpc", true);
+}
+
+} // namespace
+
+void* operator new(size_t size)
+{
+    s_allocations++;
+    if (void* pointer = std::malloc(size))
+        return pointer;
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+    std::free(pointer);
+}
+
+int main()
+{
+    static constexpr Yash::Config unbufferedConfig { .maxRequiredArgs = 3, .commandHistorySize = 10 };
+    static constexpr Yash::Config bufferedConfig { .maxRequiredArgs = 3, .commandHistorySize = 10, .outputBufferSize = 256 };
+
+    // Each result is printed as a JSON object on a separate line
+    run<unbufferedConfig>("unbuffered");
+    run<bufferedConfig>("buffered");
+    run<unbufferedConfig, CountingSink>("sink");
+
+    // The sessions of the server keep the output not taken by a client yet
+    static constexpr Yash::Config serverConfig { .maxRequiredArgs = 3, .commandHistorySize = 10, .txQueueSize = 256, .txOverflow = Yash::TxOverflow::Truncate };
+    static constexpr Yash::Config minimalServerConfig { .maxRequiredArgs = 3, .commandHistorySize = 0, .maxCommandLength = 32, .txQueueSize = 64, .txOverflow = Yash::TxOverflow::Truncate };
+    runSessions<unbufferedConfig, Yash::FunctionSink>("unbuffered");
+    runSessions<bufferedConfig, Yash::FunctionSink>("buffered");
+    runSessions<serverConfig, Yash::FileDescriptorSink>("server");
+    runSessions<minimalServerConfig, Yash::FileDescriptorSink>("minimal-server");
+    runFormat();
+    runScript();
+    runRpc();
+
+    return 0;
+}
@@ -5,6 +5,10 @@ CMAKE_ARGS="-DBUILD_TEST=1"
 
 if [ "$1" = "example" ]; then
   CMAKE_ARGS="-DBUILD_EXAMPLE=1"
+elif [ "$1" = "benchmark" ]; then
+  CMAKE_ARGS="-DBUILD_BENCHMARK=1"
+elif [ "$1" = "size" ]; then
+  CMAKE_ARGS="-DBUILD_SIZE_REPORT=1"
 fi
 
 mkdir -p .build-external; pushd .build-external
@@ -26,4 +30,12 @@ if [ "$1" = "coverage" ]; then
   echo "Coverage report can be found in $(pwd)/coverage"
 fi
 
+if [ "$1" = "benchmark" ]; then
+  ./benchmark/yash-benchmark | tee benchmark.json
+fi
+
+if [ "$1" = "size" ]; then
+  echo "Size report can be found in $(pwd)/size/size-report.txt"
+fi
+
 popd
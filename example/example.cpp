@@ -3,28 +3,34 @@
 
 #include <Yash.h>
 #include <con.h>
+#include <cstdio>
 
-void i2c(const std::string_view command, Yash::CommandArgs args)
+void i2cRead(Yash::Output& output, uint8_t address, uint8_t reg, uint8_t bytes)
 {
-    if (command == "read")
-        printf("i2cRead(%s, %s, %s)\n", args[0].data(), args[1].data(), args[2].data());
-    else if (command == "write")
-        printf("i2cWrite(%s, %s, %s)\n", args[0].data(), args[1].data(), args[2].data());
+    output.format("i2cRead(0x{:02x}, 0x{:02x}, {})\n", address, reg, bytes);
 }
 
-void info(Yash::CommandArgs /* unused */)
+void i2cWrite(Yash::Output& output, uint8_t address, uint8_t reg, const Yash::HexBytes& data)
 {
-    printf("info()\n");
+    output.format("i2cWrite(0x{:02x}, 0x{:02x},", address, reg);
+    for (size_t index = 0; index < data.size(); index++)
+        output.format(" {:02x}", data[index]);
+    output.write(")\n");
+}
+
+void info(Yash::Output& output)
+{
+    output.write("info()\n");
 }
 
 int main()
 {
     static constexpr Yash::Config config { .maxRequiredArgs = 3, .commandHistorySize = 10 };
-    static constexpr auto commands = std::to_array<Yash::Command>({
-        { "i2c read", "I2C read <addr> <reg> <bytes>", [](Yash::CommandArgs args) { i2c("read", args); }, 3 },
-        { "i2c write", "I2C write <addr> <reg> <value>", [](Yash::CommandArgs args) { i2c("write", args); }, 3 },
-        { "info", "System info", [](const auto args) { info(args); }, 0 }, // OR auto if preffered
-    });
+    static constexpr auto commands = Yash::sortCommands(std::to_array<Yash::Command>({
+        Yash::command<&i2cRead, config>("i2c read", "I2C read <addr> <reg> <bytes>"),
+        Yash::command<&i2cWrite, config>("i2c write", "I2C write <addr> <reg> <data>"),
+        Yash::command<&info, config>("info", "System info"),
+    }));
 
     Yash::Yash<config> yash(commands);
     yash.setPrint([&](const char* str) { printf("%s", str); });
@@ -3,315 +3,3188 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
 #include <cstring>
 #include <functional>
-#include <list>
 #include <numeric>
 #include <span>
-#include <string>
 #include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 
 namespace Yash {
 
+/// @brief Formats text with std::format style replacement fields (e.g. "{}" or "{:08x}") without allocating
+///
+/// The text is written in pieces to a writer called with the data and its size. A replacement field can
+/// have an argument index and a format specification with fill, alignment (<, ^ or >), a 0 flag, a width
+/// and a type (b, o, d, x or X for integers).
+class Formatter {
+public:
+    /// @brief Formats text to a writer
+    /// @param writer The writer called with each piece of the formatted text
+    /// @param format The format string
+    /// @param args The arguments, which can be integers, bool, char or text
+    template <typename TWriter, typename... TArgs>
+    static void format(TWriter& writer, std::string_view format, const TArgs&... args)
+    {
+        size_t nextIndex { 0 };
+        while (!format.empty()) {
+            size_t position { 0 };
+            while (position < format.size() && format[position] != '{' && format[position] != '}')
+                position++;
+            writer(format.data(), position);
+            if (position == format.size())
+                break;
+
+            // Braces are escaped by doubling them and a stray closing brace is written as is
+            size_t end = format.find('}', position);
+            if (end == std::string_view::npos || format[position] == '}' || format[position + 1] == '{') {
+                writer(format.data() + position, 1);
+                format.remove_prefix(position + (position + 1 < format.size() && format[position + 1] == format[position] ? 2 : 1));
+                continue;
+            }
+
+            Spec spec = parse(format.substr(position + 1, end - position - 1), nextIndex);
+            [[maybe_unused]] size_t index { 0 };
+            ((index++ == spec.index ? formatArgument(writer, spec, args) : void()), ...);
+            format.remove_prefix(end + 1);
+        }
+    }
+
+private:
+    struct Spec {
+        size_t index { 0 };
+        char fill { ' ' };
+        char align { '\0' }; // The default alignment is right for numbers and left for text
+        bool zero { false };
+        size_t width { 0 };
+        char type { '\0' };
+    };
+
+    static Spec parse(std::string_view field, size_t& nextIndex)
+    {
+        Spec spec;
+        auto digits = [&field](size_t& value) {
+            size_t size { 0 };
+            for (; size < field.size() && field[size] >= '0' && field[size] <= '9'; size++)
+                value = value * 10 + static_cast<size_t>(field[size] - '0');
+            field.remove_prefix(size);
+            return size > 0;
+        };
+
+        if (!digits(spec.index))
+            spec.index = nextIndex++;
+        if (field.empty() || field.front() != ':')
+            return spec;
+
+        field.remove_prefix(1);
+        auto isAlign = [](char character) { return character == '<' || character == '^' || character == '>'; };
+        if (field.size() > 1 && isAlign(field[1])) {
+            spec.fill = field[0];
+            spec.align = field[1];
+            field.remove_prefix(2);
+        } else if (!field.empty() && isAlign(field[0])) {
+            spec.align = field[0];
+            field.remove_prefix(1);
+        }
+
+        if (!field.empty() && field[0] == '0') {
+            spec.zero = true;
+            field.remove_prefix(1);
+        }
+        digits(spec.width);
+        if (!field.empty())
+            spec.type = field[0];
+
+        return spec;
+    }
+
+    template <typename TWriter, typename T>
+    static void formatArgument(TWriter& writer, const Spec& spec, const T& value)
+    {
+        if constexpr (std::is_same_v<T, bool>)
+            writePadded(writer, spec, value ? "true" : "false", '<');
+        else if constexpr (std::is_same_v<T, char>)
+            writePadded(writer, spec, { &value, 1 }, '<');
+        else if constexpr (std::is_integral_v<T>) {
+            int base = spec.type == 'x' || spec.type == 'X' ? 16 : spec.type == 'o' ? 8 : spec.type == 'b' ? 2 : 10;
+            std::array<char, sizeof(T) * 8 + 1> text;
+            char* end = std::to_chars(text.data(), text.data() + text.size(), value, base).ptr;
+            if (spec.type == 'X')
+                std::transform(text.data(), end, text.data(), [](char character) { return static_cast<char>(std::toupper(character)); });
+
+            std::string_view number { text.data(), static_cast<size_t>(end - text.data()) };
+            if (!spec.zero || spec.align)
+                return writePadded(writer, spec, number, '>');
+
+            // Zeros are written between the sign and the digits
+            if (number.front() == '-') {
+                writer(number.data(), 1);
+                number.remove_prefix(1);
+            }
+            writeFill(writer, '0', spec.width - std::min(spec.width, static_cast<size_t>(end - text.data())));
+            writer(number.data(), number.size());
+        } else
+            writePadded(writer, spec, std::string_view { value }, '<');
+    }
+
+    template <typename TWriter>
+    static void writePadded(TWriter& writer, const Spec& spec, std::string_view text, char defaultAlign)
+    {
+        size_t padding = spec.width > text.size() ? spec.width - text.size() : 0;
+        char align = spec.align ? spec.align : defaultAlign;
+        size_t before = align == '>' ? padding : align == '^' ? padding / 2 : 0;
+
+        writeFill(writer, spec.fill, before);
+        writer(text.data(), text.size());
+        writeFill(writer, spec.fill, padding - before);
+    }
+
+    template <typename TWriter>
+    static void writeFill(TWriter& writer, char fill, size_t count)
+    {
+        if (!count)
+            return;
+
+        std::array<char, 16> text;
+        text.fill(fill);
+        while (count) {
+            size_t size = std::min(count, text.size());
+            writer(text.data(), size);
+            count -= size;
+        }
+    }
+};
+
+/// @brief Formats text into a buffer like std::format_to_n
+/// @param buffer The buffer to be filled (the text is truncated if it does not fit)
+/// @param format The format string
+/// @param args The arguments, which can be integers, bool, char or text
+/// @return The size of the formatted text (which is larger than the buffer if it was truncated)
+template <typename... TArgs>
+size_t formatTo(std::span<char> buffer, std::string_view format, const TArgs&... args)
+{
+    size_t size { 0 };
+    auto writer = [&](const char* data, size_t dataSize) {
+        if (size < buffer.size())
+            std::copy_n(data, std::min(dataSize, buffer.size() - size), buffer.data() + size);
+        size += dataSize;
+    };
+    Formatter::format(writer, format, args...);
+    return size;
+}
+
+/// @brief The output of the shell running a command, which command handlers can write and format to
+///
+/// The output is written through the shell (to its output buffer when buffering is enabled) so it reaches
+/// the session running the command. Each "\n" is written as "\r\n" unless it already follows a "\r".
+class Output {
+public:
+    typedef void (*WriteFunction)(void* context, const char* data, size_t size);
+    typedef std::span<char> (*BufferFunction)(void* context, size_t written); // Adds the text written to the buffer and returns its free space (at least 2 bytes or none)
+
+    constexpr Output() = default;
+    constexpr Output(void* context, WriteFunction writeFunction, BufferFunction bufferFunction = nullptr)
+        : m_context(context)
+        , m_writeFunction(writeFunction)
+        , m_bufferFunction(bufferFunction)
+    {
+    }
+
+    /// @brief Writes text
+    /// @param text The text to be written
+    void write(std::string_view text)
+    {
+        if (!m_writeFunction || text.empty())
+            return;
+
+        for (size_t position = text.find('\n'); position != std::string_view::npos; position = text.find('\n')) {
+            bool carriageReturn = position ? text[position - 1] == '\r' : m_carriageReturn;
+            m_writeFunction(m_context, text.data(), position);
+            m_writeFunction(m_context, carriageReturn ? "\n" : "\r\n", carriageReturn ? 1 : 2);
+            text.remove_prefix(position + 1);
+            m_carriageReturn = false;
+            if (text.empty())
+                return;
+        }
+
+        m_writeFunction(m_context, text.data(), text.size());
+        m_carriageReturn = text.back() == '\r';
+    }
+
+    /// @brief Formats text with std::format style replacement fields (see Formatter)
+    /// @param format The format string (e.g. "{:08x}: {}\n")
+    /// @param args The arguments, which can be integers, bool, char or text
+    template <typename... TArgs>
+    void format(std::string_view format, const TArgs&... args)
+    {
+        if (!m_writeFunction)
+            return;
+
+        // The text is formatted directly into the output buffer of the shell, or into a chunk when it is not buffered
+        std::array<char, s_chunkSize> chunk;
+        std::span<char> buffer = m_bufferFunction ? m_bufferFunction(m_context, 0) : std::span<char> {};
+        bool direct = !buffer.empty();
+        if (!direct)
+            buffer = chunk;
+
+        size_t size { 0 };
+        bool carriageReturn = m_carriageReturn; // kept locally as the member might alias the buffer
+        auto writer = [&](const char* data, size_t dataSize) {
+            for (const char* end = data + dataSize; data != end; data++) {
+                if (size + 2 > buffer.size()) {
+                    buffer = direct ? m_bufferFunction(m_context, size) : (m_writeFunction(m_context, chunk.data(), size), buffer);
+                    size = 0;
+                }
+
+                if (*data == '\n' && !carriageReturn)
+                    buffer[size++] = '\r';
+                carriageReturn = *data == '\r';
+                buffer[size++] = *data;
+            }
+        };
+
+        Formatter::format(writer, format, args...);
+        m_carriageReturn = carriageReturn;
+        if (direct)
+            m_bufferFunction(m_context, size);
+        else if (size)
+            m_writeFunction(m_context, chunk.data(), size);
+    }
+
+private:
+    static constexpr size_t s_chunkSize { 64 };
+
+    void* m_context { nullptr };
+    WriteFunction m_writeFunction { nullptr };
+    BufferFunction m_bufferFunction { nullptr };
+    bool m_carriageReturn { false }; // The last character written was a "\r"
+};
+
+/// @brief The candidates for completing an argument, which are collected in a buffer supplied by the shell
+///
+/// Only the candidates starting with the typed part of the argument are kept, and the provider is told to
+/// stop when no more candidates are wanted (so candidates can be generated lazily without allocating).
+class Completions {
+public:
+    /// @brief Constructor
+    /// @param prefix The typed part of the argument
+    /// @param buffer The buffer where the candidates are stored
+    /// @param maxCandidates The maximum number of candidates (e.g. the number which can be listed on a screen)
+    constexpr Completions(std::string_view prefix, std::span<char> buffer, size_t maxCandidates)
+        : m_prefix(prefix)
+        , m_buffer(buffer)
+        , m_maxCandidates(maxCandidates)
+    {
+    }
+
+    /// @brief Gets the typed part of the argument
+    constexpr std::string_view prefix() const { return m_prefix; }
+
+    /// @brief Adds a candidate if it starts with the typed part of the argument
+    /// @param candidate The candidate which is copied (so it can be generated in a temporary buffer)
+    /// @return False if the provider should stop because no more candidates are wanted
+    constexpr bool add(std::string_view candidate)
+    {
+        if (!candidate.starts_with(m_prefix))
+            return true;
+
+        if (m_size == m_maxCandidates || candidate.size() > UINT8_MAX || m_used + candidate.size() + 1 > m_buffer.size()) {
+            m_truncated = true;
+            return false;
+        }
+
+        // The candidates are stored with their size first
+        m_buffer[m_used] = static_cast<char>(candidate.size());
+        std::copy(candidate.begin(), candidate.end(), m_buffer.begin() + m_used + 1);
+        m_used += candidate.size() + 1;
+
+        std::string_view first = at(0);
+        m_commonSize = m_size++ ? static_cast<size_t>(std::mismatch(first.begin(), first.begin() + m_commonSize, candidate.begin(), candidate.end()).first - first.begin()) : candidate.size();
+        return true;
+    }
+
+    /// @brief Gets the number of candidates
+    constexpr size_t size() const { return m_size; }
+
+    /// @brief Checks if candidates were left out because the buffer or the maximum number of candidates was exceeded
+    constexpr bool truncated() const { return m_truncated; }
+
+    /// @brief Gets the prefix shared by all candidates
+    constexpr std::string_view common() const { return m_size ? at(0).substr(0, m_commonSize) : m_prefix; }
+
+    /// @brief Calls a function for each candidate
+    /// @param function The function to be called with the candidate
+    template <typename TFunction>
+    constexpr void forEach(TFunction&& function) const
+    {
+        for (size_t offset = 0; offset < m_used; offset += static_cast<unsigned char>(m_buffer[offset]) + 1)
+            function(std::string_view { m_buffer.data() + offset + 1, static_cast<unsigned char>(m_buffer[offset]) });
+    }
+
+private:
+    constexpr std::string_view at(size_t offset) const { return { m_buffer.data() + offset + 1, static_cast<unsigned char>(m_buffer[offset]) }; }
+
+    std::string_view m_prefix;
+    std::span<char> m_buffer;
+    size_t m_maxCandidates;
+    size_t m_used { 0 };
+    size_t m_size { 0 };
+    size_t m_commonSize { 0 };
+    bool m_truncated { false };
+};
+
+/// @brief The status codes used by the shell, where a command returns 0 for success or any other value for a failure
+/// (like the exit status of a process)
+enum Status : int {
+    Success = 0,
+    Failure = 1,
+    InvalidArguments = 2, // Too few or invalid arguments (the usage of the command is printed)
+    NotFound = 127, // No command was found
+    Cancelled = 130, // The command was cancelled by Ctrl-C
+};
+
 using CommandArgs = const std::span<const std::string_view>;
 typedef void (*CommandFunction)(CommandArgs);
+typedef int (*StatusCommandFunction)(CommandArgs); // Returns the status of the command (see Status)
+typedef void (*OutputCommandFunction)(CommandArgs, Output&); // Writes through the output of the shell running the command
+typedef int (*OutputStatusCommandFunction)(CommandArgs, Output&); // Writes through the output and returns the status of the command
+typedef void (*CompletionFunction)(CommandArgs, Completions&); // Adds the candidates for the argument following the arguments
+typedef size_t (*TypedCommandFunction)(CommandArgs, Output&, int& status); // Returns the number of arguments parsed before calling the command
+typedef uint64_t (*ClockFunction)(); // Returns a monotonic time in microseconds
+
+/// @brief The state of a running asynchronous command which is kept by the shell between the steps
+struct CommandState {
+    size_t step { 0 }; // The number of times the command has been stepped before
+    uintptr_t value { 0 }; // A value kept for the command (e.g. an address or an offset)
+    bool cancelled { false }; // Set when the command is stepped a last time because it was cancelled (e.g. by Ctrl-C)
+    Output output {}; // The output of the shell running the command
+    int status { Success }; // The status of the command when it is done (see Status)
+};
+
+typedef bool (*AsyncCommandFunction)(CommandArgs, CommandState&); // Does a step of the command and returns true when it is done
+
+/// @brief The invocation statistics of a command
+struct CommandStatistics {
+    static constexpr size_t s_latencyBuckets { 20 };
+
+    uint32_t calls { 0 };
+    uint32_t errors { 0 }; // The number of calls returning a status other than Success
+    std::array<uint32_t, s_latencyBuckets> latency {}; // The calls by latency, where bucket N counts the calls under 2^N us (the last bucket counts the rest)
+
+    /// @brief Gets the latency bucket of a call
+    /// @param microseconds The latency of the call
+    static constexpr size_t bucket(uint64_t microseconds) { return std::min<size_t>(std::bit_width(microseconds), s_latencyBuckets - 1); }
+};
+
+/// @brief The result of running a script
+struct ScriptResult {
+    size_t commands { 0 }; // The number of commands run
+    size_t failures { 0 }; // The number of failed lines (e.g. unknown commands or invalid arguments)
+    size_t failedLine { 0 }; // The number of the first failed line (0 if no line failed)
+
+    /// @brief Checks if all commands of the script succeeded
+    constexpr explicit operator bool() const { return !failures; }
+};
+
+/// @brief The kinds of the function called by a command
+enum class CommandKind : uint8_t {
+    Plain,
+    Typed, // See command()
+    Async, // See asyncCommand()
+    Status, // See statusCommand()
+    Output, // See outputCommand()
+    OutputStatus, // See statusCommand()
+};
+
+struct Command {
+    std::string_view name;
+    std::string_view description;
+    union { // The function of the command given by its kind
+        CommandFunction function;
+        TypedCommandFunction typedFunction; // Parses the arguments and calls a command with typed parameters
+        AsyncCommandFunction asyncFunction; // Does a step of a long-running command
+        StatusCommandFunction statusFunction; // Is called for a command returning a status
+        OutputCommandFunction outputFunction; // Is called with the output of the shell
+        OutputStatusCommandFunction outputStatusFunction; // Is called with the output of the shell for a command returning a status
+    };
+    size_t requiredArguments;
+    CompletionFunction completion { nullptr }; // Adds the candidates for completing an argument (e.g. the valid pins)
+    std::string_view usage {}; // The parameter types of a command with typed parameters (e.g. "<u8> <hex>")
+    CommandKind kind { CommandKind::Plain };
+};
+
+/// @brief The handling of output which does not fit in the transmit queue of a non-blocking sink
+enum class TxOverflow {
+    Block, // Call the sink until the output fits (so the sink must make progress when it is called)
+    Drop, // Drop the output which does not fit
+    Truncate, // Drop the output until the queue has been emptied and queue a marker showing it was truncated
+};
+
+struct Config {
+    const size_t maxRequiredArgs; // The maximum amount of arguments provided in a callback
+    const size_t commandHistorySize;
+    const size_t commandHistoryBytes { commandHistorySize * 32 }; // The number of bytes used for storing the command history
+    const size_t outputBufferSize { 0 }; // The size of the buffer collecting the output of one input event (0 disables buffering)
+    const size_t maxCommandLength { 64 }; // The maximum length of an input line (further characters are ignored)
+    const size_t maxPromptLength { 16 };
+    const size_t inputQueueSize { 0 }; // The size (a power of two) of the queue for characters pushed from an interrupt or another thread (0 disables the queue)
+    const size_t typeAheadSize { maxCommandLength }; // The number of characters buffered while an asynchronous command is running or the input is paused
+    const size_t maxCompletions { 32 }; // The maximum number of argument completion candidates (which are listed on a double Tab)
+    const size_t completionBufferSize { 256 }; // The size of the stack buffer collecting the argument completion candidates
+    const size_t statisticsSize { 0 }; // The number of commands (from the start of the command table) with invocation statistics (0 disables them)
+    const size_t rpcFrameSize { 0 }; // The maximum payload size of the response frames of the RPC mode (0 disables the mode)
+    const size_t txQueueSize { 0 }; // The size of the queue for output not accepted by a non-blocking sink (0 disables the queue)
+    const size_t txHighWater { txQueueSize * 3 / 4 }; // Input is paused while the transmit queue holds more output than this
+    const TxOverflow txOverflow { TxOverflow::Block };
+    const bool editing { true }; // Moving the cursor and editing within the input line (e.g. Ctrl-A/E/K/U/W and the arrow keys)
+    const bool keySequences { true }; // Decoding of escape sequences and control keys (otherwise control characters are ignored)
+    const bool completion { true }; // Tab completion of commands and arguments
+    const bool help { true }; // Listing the matching (grouped) commands when a command is not found
+    const bool chaining { true }; // Chaining commands with ;, && and ||, and the repeat and time built-ins
+    const bool asyncCommands { true }; // Long-running commands stepped by poll() (see asyncCommand()), which fail when disabled
+};
+
+/// @brief A string with a fixed capacity which is always terminated and never allocates
+template <size_t TCapacity>
+class FixedString {
+public:
+    constexpr FixedString() = default;
+    constexpr FixedString(std::string_view text) { assign(text); }
+
+    constexpr size_t size() const { return m_size; }
+    constexpr size_t length() const { return m_size; }
+    constexpr size_t capacity() const { return TCapacity; }
+    constexpr bool empty() const { return !m_size; }
+    constexpr bool full() const { return m_size == TCapacity; }
+    constexpr char* data() { return m_data.data(); }
+    constexpr const char* data() const { return m_data.data(); }
+    constexpr const char* c_str() const { return m_data.data(); }
+    constexpr char at(size_t position) const { return m_data.at(position); }
+    constexpr operator std::string_view() const { return { m_data.data(), m_size }; }
+    constexpr bool operator==(std::string_view other) const { return std::string_view(*this) == other; }
+
+    constexpr void clear()
+    {
+        m_size = 0;
+        m_data[0] = '\0';
+    }
+
+    /// @brief Inserts a character at the given position
+    /// @return False if the string is full and the character was not inserted
+    constexpr bool insert(size_t position, char character)
+    {
+        if (full() || position > m_size)
+            return false;
+
+        std::copy_backward(m_data.begin() + position, m_data.begin() + m_size + 1, m_data.begin() + m_size + 2);
+        m_data[position] = character;
+        m_size++;
+        return true;
+    }
+
+    /// @brief Appends a character at the end
+    /// @return False if the string is full and the character was not appended
+    constexpr bool push_back(char character) { return insert(m_size, character); }
+
+    /// @brief Erases a number of characters from the given position
+    constexpr void erase(size_t position, size_t count = 1)
+    {
+        if (position >= m_size)
+            return;
+
+        count = std::min(count, m_size - position);
+        std::copy(m_data.begin() + position + count, m_data.begin() + m_size + 1, m_data.begin() + position);
+        m_size -= count;
+    }
+
+    /// @brief Replaces the string with the given text
+    /// @return False if the text did not fit in which case it is truncated
+    constexpr bool assign(std::string_view text)
+    {
+        m_size = std::min(text.size(), TCapacity);
+        std::copy_n(text.begin(), m_size, m_data.begin());
+        m_data[m_size] = '\0';
+        return m_size == text.size();
+    }
+
+private:
+    std::array<char, TCapacity + 1> m_data {};
+    size_t m_size { 0 };
+};
+
+using CommandSpan = const std::span<const Command>;
+
+/// @brief Compares command names limited to the size of a prefix (used for prefix searches)
+///
+/// The characters before the offset are known to be the same for the commands being searched (e.g. the words
+/// already matched) so they are skipped. The remaining characters are compared in place as they are usually
+/// few, which is faster than calling memcmp().
+struct CommandPrefixCompare {
+    size_t prefixSize;
+    size_t offset { 0 };
+
+    constexpr bool operator()(const Command& command, std::string_view prefix) const { return less(command.name.substr(offset, prefixSize - offset), prefix.substr(offset)); }
+    constexpr bool operator()(std::string_view prefix, const Command& command) const { return less(prefix.substr(offset), command.name.substr(offset, prefixSize - offset)); }
+
+    static constexpr bool less(std::string_view lhs, std::string_view rhs)
+    {
+        size_t size = std::min(lhs.size(), rhs.size());
+        for (size_t index = 0; index < size; index++) {
+            if (lhs[index] != rhs[index])
+                return static_cast<unsigned char>(lhs[index]) < static_cast<unsigned char>(rhs[index]);
+        }
+
+        return lhs.size() < rhs.size();
+    }
+};
+
+/// @brief Sorts the commands by name as required by Yash (can be used on a constexpr array)
+/// @param commands The array with the commands to be sorted
+/// @return The sorted array
+template <size_t N>
+constexpr std::array<Command, N> sortCommands(std::array<Command, N> commands)
+{
+    std::sort(commands.begin(), commands.end(), [](const Command& lhs, const Command& rhs) { return lhs.name < rhs.name; });
+    return commands;
+}
+
+/// @brief Checks if the commands are sorted by name as required by Yash
+/// @param commands The commands to be checked
+/// @return True if the commands are sorted
+constexpr bool isSorted(CommandSpan commands)
+{
+    return std::is_sorted(commands.begin(), commands.end(), [](const Command& lhs, const Command& rhs) { return lhs.name < rhs.name; });
+}
+
+/// @brief Called when the commands of a command table are not sorted, which fails the compilation as it is not constexpr
+inline void commandsNotSortedByName()
+{
+}
+
+/// @brief The commands of a shell and the values derived from them, which can be shared by several shells
+///
+/// The table is created at compile time (an array of commands converts to a table) so unsorted commands, which
+/// would not be found by the binary search, fail the compilation.
+class CommandTable {
+public:
+    /// @brief Constructor
+    /// @param commands A reference to a constexpr array with the commands sorted by name
+    template <size_t N>
+    consteval CommandTable(const std::array<Command, N>& commands)
+        : CommandTable(CommandSpan { commands })
+    {
+    }
+
+    /// @brief Constructor
+    /// @param commands The constexpr commands sorted by name
+    consteval explicit CommandTable(CommandSpan commands)
+        : m_commands(commands)
+        , m_nameAlignment(std::accumulate(commands.begin(), commands.end(), size_t { 0 }, [](size_t max, const Command& command) {
+            return std::max(max, command.name.substr(0, command.name.find(' ')).size());
+        }))
+    {
+        if (!isSorted(commands))
+            commandsNotSortedByName(); // see sortCommands()
+    }
+
+    constexpr CommandSpan commands() const { return m_commands; }
+
+    /// @brief Gets the size of the longest first word of the command names (used for aligning the descriptions)
+    constexpr size_t nameAlignment() const { return m_nameAlignment; }
+
+private:
+    std::span<const Command> m_commands;
+    size_t m_nameAlignment;
+};
+
+/// @brief A command argument with bytes written as hex digits (e.g. "0a1b2c") which are decoded when read
+class HexBytes {
+public:
+    constexpr HexBytes() = default;
+    constexpr explicit HexBytes(std::string_view digits)
+        : m_digits(digits)
+    {
+    }
+
+    constexpr size_t size() const { return m_digits.size() / 2; }
+    constexpr bool empty() const { return m_digits.empty(); }
+    constexpr std::string_view digits() const { return m_digits; }
+
+    /// @brief Gets a byte
+    /// @param index The index of the byte
+    /// @return The value of the byte
+    constexpr uint8_t operator[](size_t index) const { return static_cast<uint8_t>(value(m_digits[index * 2]) << 4 | value(m_digits[index * 2 + 1])); }
+
+    /// @brief Checks if a character is a hex digit
+    static constexpr bool isDigit(char character) { return value(character) < 16; }
+
+private:
+    static constexpr uint8_t value(char character)
+    {
+        if (character >= '0' && character <= '9')
+            return static_cast<uint8_t>(character - '0');
+        if (character >= 'a' && character <= 'f')
+            return static_cast<uint8_t>(character - 'a' + 10);
+        if (character >= 'A' && character <= 'F')
+            return static_cast<uint8_t>(character - 'A' + 10);
+
+        return UINT8_MAX;
+    }
+
+    std::string_view m_digits;
+};
+
+/// @brief Parses a command argument of a type (specialized for the supported parameter types of typed commands)
+template <typename T>
+struct Argument;
+
+/// @brief Integers written as decimal or hex (with a "0x" prefix) which must fit in the type
+template <typename T>
+    requires std::is_integral_v<T>
+struct Argument<T> {
+    static constexpr std::string_view s_name { sizeof(T) == 1 ? (std::is_signed_v<T> ? "i8" : "u8")
+            : sizeof(T) == 2                                  ? (std::is_signed_v<T> ? "i16" : "u16")
+            : sizeof(T) == 4                                  ? (std::is_signed_v<T> ? "i32" : "u32")
+                                                              : (std::is_signed_v<T> ? "i64" : "u64") };
+
+    static bool parse(std::string_view text, T& value)
+    {
+        int base { 10 };
+        if (text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+            text.remove_prefix(2);
+            base = 16;
+        }
+
+        auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value, base);
+        return error == std::errc {} && end == text.data() + text.size();
+    }
+};
+
+/// @brief Booleans written as 1/0, true/false or on/off
+template <>
+struct Argument<bool> {
+    static constexpr std::string_view s_name { "bool" };
+
+    static constexpr bool parse(std::string_view text, bool& value)
+    {
+        value = text == "1" || text == "true" || text == "on";
+        return value || text == "0" || text == "false" || text == "off";
+    }
+};
+
+/// @brief Text which is passed as is
+template <>
+struct Argument<std::string_view> {
+    static constexpr std::string_view s_name { "string" };
+
+    static constexpr bool parse(std::string_view text, std::string_view& value)
+    {
+        value = text;
+        return true;
+    }
+};
+
+/// @brief Bytes written as an even number of hex digits
+template <>
+struct Argument<HexBytes> {
+    static constexpr std::string_view s_name { "hex" };
+
+    static constexpr bool parse(std::string_view text, HexBytes& value)
+    {
+        value = HexBytes { text };
+        return !text.empty() && text.size() % 2 == 0 && std::all_of(text.begin(), text.end(), HexBytes::isDigit);
+    }
+};
+
+/// @brief Generates the argument parsing and usage of typed parameters at compile time
+template <typename... TParameters>
+struct TypedParameters {
+    static constexpr size_t s_parameters { sizeof...(TParameters) };
+
+    /// @brief Parses the arguments and calls a function with the values if all of them were valid
+    /// @param args The arguments which must be at least as many as the parameters
+    /// @param function The function to be called with the values
+    /// @return The number of arguments parsed (which is less than the number of parameters if one was invalid)
+    template <typename TFunction>
+    static size_t parse(CommandArgs args, TFunction&& function)
+    {
+        std::tuple<std::remove_cvref_t<TParameters>...> values;
+
+        return [&]<size_t... TIndices>(std::index_sequence<TIndices...>) {
+            // Parse the arguments in order until one is invalid
+            size_t parsed { 0 };
+            if (((Argument<std::remove_cvref_t<TParameters>>::parse(args[TIndices], std::get<TIndices>(values)) && ++parsed) && ...))
+                function(std::get<TIndices>(values)...);
+
+            return parsed;
+        }(std::index_sequence_for<TParameters...> {});
+    }
+
+    static constexpr auto s_usageText = [] {
+        std::array<char, ((Argument<std::remove_cvref_t<TParameters>>::s_name.size() + 3) + ... + 0)> text {};
+        auto end = text.begin();
+        [[maybe_unused]] auto append = [&end](std::string_view name) {
+            *end++ = '<';
+            end = std::copy(name.begin(), name.end(), end);
+            *end++ = '>';
+            *end++ = ' ';
+        };
+        (append(Argument<std::remove_cvref_t<TParameters>>::s_name), ...);
+        return text;
+    }();
+
+    static constexpr std::string_view s_usage { s_usageText.data(), s_parameters ? s_usageText.size() - 1 : 0 };
+};
+
+/// @brief Calls a function returning nothing (which always succeeds) or a status
+template <auto TFunction, typename... TValues>
+int callWithStatus(TValues&&... values)
+{
+    if constexpr (std::is_void_v<decltype(TFunction(std::forward<TValues>(values)...))>) {
+        TFunction(std::forward<TValues>(values)...);
+        return Success;
+    } else
+        return TFunction(std::forward<TValues>(values)...);
+}
+
+/// @brief Generates the calling of a function with typed parameters at compile time
+template <auto TFunction, typename... TParameters>
+struct TypedCall : TypedParameters<TParameters...> {
+    static size_t call(CommandArgs args, Output& /* unused */, int& status)
+    {
+        return TypedCall::parse(args, [&status](auto&... values) { status = callWithStatus<TFunction>(values...); });
+    }
+};
+
+/// @brief A function receiving the output of the shell before the typed parameters
+template <auto TFunction, typename... TParameters>
+struct TypedCall<TFunction, Output&, TParameters...> : TypedParameters<TParameters...> {
+    static size_t call(CommandArgs args, Output& output, int& status)
+    {
+        return TypedCall::parse(args, [&output, &status](auto&... values) { status = callWithStatus<TFunction>(output, values...); });
+    }
+};
+
+template <auto TFunction>
+struct TypedCommand;
+
+template <typename TResult, typename... TParameters, TResult (*TFunction)(TParameters...)>
+struct TypedCommand<TFunction> : TypedCall<TFunction, TParameters...> {
+    static_assert(std::is_void_v<TResult> || std::is_same_v<TResult, int>, "A typed command returns nothing or a status");
+};
+
+/// @brief Creates a command calling a function with typed parameters (e.g. void i2cRead(uint8_t address, uint16_t reg))
+/// @tparam TFunction The function to be called, where the parameters can be integers, bool, std::string_view or HexBytes
+///                   (following an optional Output& where the output of the shell is passed), which can return a status
+/// @param name The name of the command
+/// @param description The description of the command
+/// @param completion The function adding the candidates for completing an argument
+/// @return The command where the required arguments and the usage are generated from the parameters
+///
+/// The arguments are parsed and validated before the function is called, and the usage is printed if they are invalid.
+template <auto TFunction>
+constexpr Command command(std::string_view name, std::string_view description, CompletionFunction completion = nullptr)
+{
+    return { name, description, { .typedFunction = &TypedCommand<TFunction>::call }, TypedCommand<TFunction>::s_parameters, completion, TypedCommand<TFunction>::s_usage, CommandKind::Typed };
+}
+
+/// @brief Creates a command calling a function with typed parameters for a shell with a configuration
+/// @tparam TFunction The function to be called (see command())
+/// @tparam TConfig The configuration of the shell, which must provide an argument for each parameter
+/// @param name The name of the command
+/// @param description The description of the command
+/// @param completion The function adding the candidates for completing an argument
+/// @return The command, which fails to compile if the function has more parameters than the maxRequiredArgs
+template <auto TFunction, Config TConfig>
+    requires(TypedCommand<TFunction>::s_parameters <= TConfig.maxRequiredArgs)
+constexpr Command command(std::string_view name, std::string_view description, CompletionFunction completion = nullptr)
+{
+    return command<TFunction>(name, description, completion);
+}
+
+/// @brief Creates a long-running command which is stepped by Yash::poll() until it is done
+/// @param name The name of the command
+/// @param description The description of the command
+/// @param function The function doing a step of the command (e.g. dumping a block of flash)
+/// @param requiredArguments The number of required arguments
+/// @param completion The function adding the candidates for completing an argument
+/// @return The command
+///
+/// The shell stays responsive while the command is running. The command is stepped a last time with
+/// CommandState::cancelled set when Ctrl-C is received, and any other input is handled when it is done.
+constexpr Command asyncCommand(std::string_view name, std::string_view description, AsyncCommandFunction function, size_t requiredArguments = 0, CompletionFunction completion = nullptr)
+{
+    return { name, description, { .asyncFunction = function }, requiredArguments, completion, {}, CommandKind::Async };
+}
+
+/// @brief Creates a command returning a status, which is used when commands are chained with && or ||
+/// @param name The name of the command
+/// @param description The description of the command
+/// @param function The function to be called, returning 0 for success or any other value for a failure
+/// @param requiredArguments The number of required arguments
+/// @param completion The function adding the candidates for completing an argument
+/// @return The command
+constexpr Command statusCommand(std::string_view name, std::string_view description, StatusCommandFunction function, size_t requiredArguments = 0, CompletionFunction completion = nullptr)
+{
+    return { name, description, { .statusFunction = function }, requiredArguments, completion, {}, CommandKind::Status };
+}
+
+/// @brief Creates a command returning a status which writes through the output of the shell running it
+/// @param name The name of the command
+/// @param description The description of the command
+/// @param function The function to be called, returning 0 for success or any other value for a failure
+/// @param requiredArguments The number of required arguments
+/// @param completion The function adding the candidates for completing an argument
+/// @return The command
+constexpr Command statusCommand(std::string_view name, std::string_view description, OutputStatusCommandFunction function, size_t requiredArguments = 0, CompletionFunction completion = nullptr)
+{
+    return { name, description, { .outputStatusFunction = function }, requiredArguments, completion, {}, CommandKind::OutputStatus };
+}
+
+/// @brief Creates a command which writes through the output of the shell running it (see Output)
+/// @param name The name of the command
+/// @param description The description of the command
+/// @param function The function to be called
+/// @param requiredArguments The number of required arguments
+/// @param completion The function adding the candidates for completing an argument
+/// @return The command
+///
+/// The output reaches the session running the command (e.g. a telnet connection) instead of a fixed output.
+constexpr Command outputCommand(std::string_view name, std::string_view description, OutputCommandFunction function, size_t requiredArguments = 0, CompletionFunction completion = nullptr)
+{
+    return { name, description, { .outputFunction = function }, requiredArguments, completion, {}, CommandKind::Output };
+}
+
+/// @brief A command history stored as packed entries in a circular byte arena which never allocates
+/// @tparam TEntries The maximum number of entries
+/// @tparam TBytes The number of bytes used for storing the entries
+///
+/// Entries are stored contiguously (an entry which does not fit at the end of the arena is stored
+/// at the beginning instead) so they can be returned as views. The oldest entries are evicted
+/// when there is no room for a new entry.
+template <size_t TEntries, size_t TBytes>
+class CommandHistory {
+public:
+    constexpr size_t size() const { return m_size; }
+    constexpr bool empty() const { return !m_size; }
+
+    /// @brief Gets an entry
+    /// @param age The age of the entry where 0 is the newest
+    /// @return A view of the entry
+    constexpr std::string_view at(size_t age) const
+    {
+        const Entry& entry = m_entries[index(m_size - 1 - age)];
+        return { m_bytes.data() + entry.offset, entry.size };
+    }
+
+    /// @brief Adds an entry unless it is empty, too large or the same as the newest entry
+    /// @param text The entry to be added
+    /// @return True if the entry was added
+    constexpr bool push(std::string_view text)
+    {
+        if (!TEntries || text.empty() || text.size() > TBytes || (m_size && at(0) == text))
+            return false;
+
+        const bool wrap = m_end + text.size() > TBytes;
+        const size_t offset = wrap ? 0 : m_end;
+
+        // The entries follow the end of the newest entry from the oldest to the newest, so the
+        // overlapped entries are always the oldest ones when the bytes after the end are skipped
+        // on a wrap (and all of them are evicted when the entries are full)
+        while (m_size) {
+            const Entry& oldest = m_entries[m_first];
+            const bool skipped = wrap && oldest.offset >= m_end;
+            if (m_size < TEntries && !skipped && (oldest.offset >= offset + text.size() || oldest.offset + oldest.size <= offset))
+                break;
+
+            m_first = index(1);
+            m_size--;
+        }
+
+        std::copy(text.begin(), text.end(), m_bytes.begin() + offset);
+        m_entries[index(m_size)] = { static_cast<Offset>(offset), static_cast<Offset>(text.size()) };
+        m_end = offset + text.size();
+        m_size++;
+        return true;
+    }
+
+    constexpr void clear()
+    {
+        m_first = 0;
+        m_size = 0;
+        m_end = 0;
+    }
+
+private:
+    constexpr size_t index(size_t position) const
+    {
+        if constexpr (TEntries > 0)
+            return (m_first + position) % TEntries;
+        else
+            return 0;
+    }
+
+    using Offset = std::conditional_t<(TBytes <= UINT16_MAX), uint16_t, uint32_t>;
+
+    struct Entry {
+        Offset offset;
+        Offset size;
+    };
+
+    std::array<char, TBytes> m_bytes {};
+    std::array<Entry, std::max<size_t>(TEntries, 1)> m_entries {};
+    size_t m_first { 0 };
+    size_t m_size { 0 };
+    size_t m_end { 0 };
+};
+
+/// @brief A lock-free single producer single consumer queue of received characters which never allocates
+/// @tparam TCapacity The maximum number of characters in the queue
+///
+/// Characters can be pushed by one producer (e.g. a UART interrupt or a reader thread) while they
+/// are popped by one consumer (e.g. the task calling Yash::poll()).
+template <size_t TCapacity>
+class InputQueue {
+    // The positions wrap around at SIZE_MAX, which only keeps the slots in order when the capacity divides it
+    static_assert(std::has_single_bit(TCapacity), "The capacity of the input queue must be a power of two");
+
+public:
+    /// @brief Pushes a character (only called by the producer)
+    /// @param character The character to be pushed
+    /// @return False if the queue was full in which case the character is dropped and counted as an overflow
+    bool push(char character)
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) == TCapacity) {
+            // Only the producer writes the counter so it does not need an atomic increment (which some MCUs lack)
+            m_overflows.store(m_overflows.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        m_data[head % TCapacity] = character;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// @brief Pops a number of characters (only called by the consumer)
+    /// @param characters The span to be filled with the characters
+    /// @return The number of characters popped
+    size_t pop(std::span<char> characters)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        size_t size = std::min(m_head.load(std::memory_order_acquire) - tail, characters.size());
+        for (size_t index = 0; index < size; index++)
+            characters[index] = m_data[(tail + index) % TCapacity];
+
+        m_tail.store(tail + size, std::memory_order_release);
+        return size;
+    }
+
+    /// @brief Gets the number of characters in the queue
+    size_t size() const { return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire); }
+
+    /// @brief Gets the number of characters dropped because the queue was full
+    size_t overflows() const { return m_overflows.load(std::memory_order_relaxed); }
+
+    static constexpr size_t capacity() { return TCapacity; }
+
+private:
+    // The positions are only incremented (and wrap around) so a full queue can be told from an empty queue
+    std::atomic<size_t> m_head { 0 }; // Written by the producer
+    std::atomic<size_t> m_tail { 0 }; // Written by the consumer
+    std::atomic<size_t> m_overflows { 0 }; // Written by the producer
+    std::array<char, TCapacity> m_data;
+};
+
+/// @brief An input queue which is disabled (takes no space)
+template <>
+class InputQueue<0> {
+};
+
+/// @brief The statuses of the RPC response frames which are not statuses of commands
+enum RpcStatus : uint8_t {
+    RpcOutput = 0xff, // The frame holds output of the command and more frames follow
+    RpcInvalidFrame = 0xfe, // The request frame had an invalid CRC or a payload larger than the maxCommandLength
+    RpcFailure = 0xfd, // The command failed with a status which is not in 0..252 (e.g. a negative status or 256)
+};
+
+/// @brief Gets the status of the last response frame of a command
+/// @param status The status of the command
+/// @return The status, or RpcFailure if it would be truncated or collide with another RpcStatus
+constexpr uint8_t rpcStatus(int status) { return status >= 0 && status < RpcFailure ? static_cast<uint8_t>(status) : static_cast<uint8_t>(RpcFailure); }
+
+/// @brief A frame of the RPC mode used for host automation
+///
+/// A frame is the start byte (s_start), the payload size (u16), the sequence number (u8), the status (u8),
+/// the payload and the CRC-16/CCITT-FALSE of the preceding bytes (u16), where the integers are little endian.
+/// A request holds a command line, and the output of the command is streamed in response frames with the same
+/// sequence number where the last frame holds the status of the command (see RpcStatus).
+struct RpcFrame {
+    static constexpr char s_start { '\x16' }; // Starts a frame, so the characters after an invalid frame are skipped until the next frame
+    static constexpr size_t s_headerSize { 5 };
+    static constexpr size_t s_overhead { s_headerSize + 2 }; // The size of a frame without the payload
+    static constexpr std::string_view s_magic { "\x16YASH-RPC\n" }; // Enters the RPC mode when received by the shell
+
+    uint8_t sequence { 0 };
+    uint8_t status { 0 };
+    std::string_view payload;
+
+    /// @brief Updates a CRC-16/CCITT-FALSE with a number of bytes
+    /// @param crc The CRC of the preceding bytes
+    /// @param data The bytes
+    /// @return The updated CRC
+    static constexpr uint16_t crc(uint16_t crc, std::span<const char> data)
+    {
+        for (char character : data)
+            crc = static_cast<uint16_t>(crc << 8) ^ s_crcTable[(crc >> 8) ^ static_cast<uint8_t>(character)];
+        return crc;
+    }
+
+    /// @brief Encodes the frame
+    /// @param buffer The buffer for the frame, which must have room for the payload and the s_overhead
+    /// @return The size of the frame (or 0 if it did not fit)
+    constexpr size_t encode(std::span<char> buffer) const
+    {
+        size_t size = payload.size() + s_overhead;
+        if (size > buffer.size() || payload.size() > UINT16_MAX)
+            return 0;
+
+        writeHeader(buffer, payload.size(), sequence, status);
+        std::copy(payload.begin(), payload.end(), buffer.begin() + s_headerSize);
+        writeCrc(buffer.first(size));
+        return size;
+    }
+
+    /// @brief Writes the header of a frame
+    static constexpr void writeHeader(std::span<char> frame, size_t payloadSize, uint8_t sequence, uint8_t status)
+    {
+        frame[0] = s_start;
+        frame[1] = static_cast<char>(payloadSize & 0xff);
+        frame[2] = static_cast<char>(payloadSize >> 8);
+        frame[3] = static_cast<char>(sequence);
+        frame[4] = static_cast<char>(status);
+    }
+
+    /// @brief Writes the CRC of the header and the payload at the end of a frame
+    /// @param frame The frame
+    static constexpr void writeCrc(std::span<char> frame)
+    {
+        uint16_t value = crc(0xffff, frame.first(frame.size() - 2));
+        frame[frame.size() - 2] = static_cast<char>(value & 0xff);
+        frame[frame.size() - 1] = static_cast<char>(value >> 8);
+    }
+
+private:
+    static constexpr auto s_crcTable = [] {
+        std::array<uint16_t, 256> table {};
+        for (size_t index = 0; index < table.size(); index++) {
+            uint16_t value = static_cast<uint16_t>(index << 8);
+            for (size_t bit = 0; bit < 8; bit++)
+                value = static_cast<uint16_t>(value & 0x8000 ? (value << 1) ^ 0x1021 : value << 1);
+            table[index] = value;
+        }
+        return table;
+    }();
+};
+
+/// @brief Decodes RPC frames received character by character
+/// @tparam TCapacity The maximum payload size (larger frames are invalid)
+///
+/// The characters before the start byte of a frame are skipped, so the decoder synchronizes with the next
+/// frame after an invalid frame (e.g. a frame where the size was corrupted).
+template <size_t TCapacity>
+class RpcDecoder {
+public:
+    enum class Result {
+        Pending, // More characters are needed
+        Frame, // A frame has been received (see frame())
+        Invalid, // A frame with an invalid CRC or a too large payload has been received and dropped
+    };
+
+    /// @brief Pushes a received character
+    /// @param character The character
+    /// @return The result of the character
+    constexpr Result push(char character)
+    {
+        if (!m_received && character != RpcFrame::s_start)
+            return Result::Pending; // skipped until the start of a frame
+
+        if (m_received < RpcFrame::s_headerSize)
+            m_header[m_received] = static_cast<uint8_t>(character);
+        else if (m_received < RpcFrame::s_headerSize + payloadSize()) {
+            size_t position = m_received - RpcFrame::s_headerSize;
+            if (position < TCapacity)
+                m_payload[position] = character;
+        } else
+            m_frameCrc |= static_cast<uint16_t>(static_cast<uint8_t>(character) << (m_received - RpcFrame::s_headerSize - payloadSize()) * 8);
+
+        if (m_received++ < RpcFrame::s_headerSize + payloadSize())
+            m_crc = RpcFrame::crc(m_crc, { &character, 1 });
+        if (m_received == RpcFrame::s_headerSize && payloadSize() > TCapacity)
+            return end(false); // the payload is not waited for as the size might be corrupted
+        if (m_received < payloadSize() + RpcFrame::s_overhead)
+            return Result::Pending;
+
+        return end(m_crc == m_frameCrc);
+    }
+
+    /// @brief Gets the last frame received (which is valid until the next character is pushed)
+    constexpr RpcFrame frame() const { return { m_header[3], m_header[4], { m_payload.data(), std::min(m_size, TCapacity) } }; }
+
+    /// @brief Drops a partially received frame
+    constexpr void reset() { *this = {}; }
+
+private:
+    constexpr size_t payloadSize() const { return m_received < 3 ? 0 : m_header[1] | static_cast<size_t>(m_header[2]) << 8; }
+
+    /// @brief Ends the frame being received
+    /// @param valid True if the frame is valid
+    /// @return The result of the frame
+    constexpr Result end(bool valid)
+    {
+        m_size = payloadSize();
+        m_received = 0;
+        m_crc = 0xffff;
+        m_frameCrc = 0;
+        return valid ? Result::Frame : Result::Invalid;
+    }
+
+    std::array<uint8_t, RpcFrame::s_headerSize> m_header {};
+    std::array<char, TCapacity> m_payload;
+    size_t m_received { 0 };
+    size_t m_size { 0 };
+    uint16_t m_crc { 0xffff };
+    uint16_t m_frameCrc { 0 };
+};
+
+/// @brief The state of a feature which is disabled in the Config (takes no space)
+template <typename T>
+struct Disabled {
+};
+
+/// @brief The type of the state of a feature which is an empty type when the feature is disabled
+template <bool TEnabled, typename T>
+using Feature = std::conditional_t<TEnabled, T, Disabled<T>>;
+
+/// @brief The functions used for storing the command history persistently (e.g. in a file or flash)
+///
+/// The history is stored as a header followed by length prefixed entries. New entries are appended
+/// and the storage is only rewritten when it has grown to twice the size of the history.
+struct HistoryStorage {
+    size_t (*read)(void* context, size_t offset, char* data, size_t size) { nullptr }; // Reads from the offset and returns the number of bytes read
+    void (*append)(void* context, const char* data, size_t size) { nullptr }; // Appends the data at the end
+    void (*clear)(void* context) { nullptr }; // Erases all data
+    void* context { nullptr }; // Passed to the functions (e.g. a file or a flash driver)
+};
+
+/// @brief The keys decoded from the received characters
+enum class Key : uint8_t {
+    None, // The character is part of an incomplete or ignored key sequence
+    Character, // The character is not part of a key sequence
+    Up,
+    Down,
+    Right,
+    Left,
+    Home,
+    End,
+    Delete,
+    WordRight,
+    WordLeft,
+    DeleteToEnd,
+    DeleteToStart,
+    DeleteWordLeft
+};
+
+/// @brief The transition table used for decoding ANSI/VT100 key sequences (generated at compile time)
+///
+/// Characters used by the key sequences get their own character class while the remaining characters
+/// share a class with the characters having the same meaning in a sequence, which keeps the table small.
+class KeyTable {
+public:
+    struct Transition {
+        uint8_t state;
+        Key key;
+    };
+
+    template <size_t TStates, size_t TClasses>
+    struct Table {
+        std::array<uint8_t, 256> classes; // The class of each character (characters not used by any sequence share a class)
+        std::array<std::array<Transition, TClasses>, TStates> transitions;
+        size_t stateCount;
+        size_t classCount;
+    };
+
+private:
+    enum class StateKind {
+        Idle,
+        Escape, // After an escape where the next character completes an Alt key
+        ControlSequence, // Within a control sequence (ESC [) which ends with a final character
+        Skip, // Skipping an unknown control sequence until its final character
+        Other // Within another sequence (e.g. ESC O) which ends with the next character
+    };
+
+    enum CharacterClass : uint8_t {
+        ControlClass,
+        ParameterClass, // Parameter and intermediate characters of a control sequence
+        FinalClass, // Final characters of a control sequence
+        CharacterClasses
+    };
+
+    struct KeySequence {
+        std::string_view sequence;
+        Key key;
+    };
+
+    static constexpr std::array<KeySequence, 27> s_keySequences { {
+        { "\x01", Key::Home }, // Ctrl-A
+        { "\x05", Key::End }, // Ctrl-E
+        { "\x0b", Key::DeleteToEnd }, // Ctrl-K
+        { "\x15", Key::DeleteToStart }, // Ctrl-U
+        { "\x17", Key::DeleteWordLeft }, // Ctrl-W
+        { "\033[A", Key::Up },
+        { "\033[B", Key::Down },
+        { "\033[C", Key::Right },
+        { "\033[D", Key::Left },
+        { "\033[H", Key::Home },
+        { "\033[F", Key::End },
+        { "\033[1~", Key::Home },
+        { "\033[3~", Key::Delete },
+        { "\033[4~", Key::End },
+        { "\033[7~", Key::Home }, // rxvt
+        { "\033[8~", Key::End }, // rxvt
+        { "\033[1;5C", Key::WordRight }, // Ctrl-Right
+        { "\033[1;5D", Key::WordLeft }, // Ctrl-Left
+        { "\033OA", Key::Up }, // Application cursor keys
+        { "\033OB", Key::Down },
+        { "\033OC", Key::Right },
+        { "\033OD", Key::Left },
+        { "\033OH", Key::Home },
+        { "\033OF", Key::End },
+        { "\033b", Key::WordLeft }, // Alt-b
+        { "\033f", Key::WordRight }, // Alt-f
+        { "\033\x7f", Key::DeleteWordLeft }, // Alt-Backspace
+    } };
+
+    static constexpr uint8_t s_skip { 1 }; // Skipping an unknown control sequence until its final character
+    static constexpr size_t s_sequencesSize { std::accumulate(s_keySequences.begin(), s_keySequences.end(), size_t { 0 }, [](size_t size, const KeySequence& keySequence) { return size + keySequence.sequence.size(); }) };
+
+public:
+    static constexpr uint8_t s_idle { 0 };
+    static constexpr size_t s_maxStates { s_sequencesSize + 2 };
+    static constexpr size_t s_maxClasses { s_sequencesSize + CharacterClasses };
+
+    /// @brief Builds the transition table
+    /// @tparam TStates The number of states (at least the number of states needed)
+    /// @tparam TClasses The number of character classes (at least the number of classes needed)
+    template <size_t TStates, size_t TClasses>
+    static constexpr Table<TStates, TClasses> build()
+    {
+        Table<TStates, TClasses> table {};
+        std::array<unsigned char, TClasses> classCharacters { 0, '0', '@' }; // A character of each class
+        std::array<bool, 256> used {};
+
+        // Every character used by a sequence gets its own class
+        for (unsigned char character = 0; auto& characterClass : table.classes) {
+            characterClass = isControl(character) ? ControlClass : character < 0x40 ? ParameterClass : FinalClass;
+            character++;
+        }
+        table.classCount = CharacterClasses;
+        for (const auto& keySequence : s_keySequences) {
+            for (char character : keySequence.sequence) {
+                auto index = static_cast<unsigned char>(character);
+                if (!used[index]) {
+                    used[index] = true;
+                    classCharacters[table.classCount] = index;
+                    table.classes[index] = static_cast<uint8_t>(table.classCount++);
+                }
+            }
+        }
+
+        auto addState = [&](StateKind kind) {
+            for (size_t characterClass = 0; characterClass < table.classCount; characterClass++)
+                table.transitions[table.stateCount][characterClass] = defaultTransition(kind, classCharacters[characterClass]);
+            return static_cast<uint8_t>(table.stateCount++);
+        };
+        addState(StateKind::Idle);
+        addState(StateKind::Skip);
+
+        // Add the sequences as a tree of states starting from the idle state
+        for (const auto& [sequence, key] : s_keySequences) {
+            uint8_t state = s_idle;
+            for (size_t index = 0; index < sequence.size(); index++) {
+                Transition& transition = table.transitions[state][table.classes[static_cast<unsigned char>(sequence[index])]];
+                if (index + 1 == sequence.size()) {
+                    transition = { s_idle, key };
+                    break;
+                }
+
+                if (transition.state <= s_skip) {
+                    std::string_view prefix = sequence.substr(0, index + 1);
+                    transition = { addState(prefix == "\033" ? StateKind::Escape : prefix.starts_with("\033[") ? StateKind::ControlSequence : StateKind::Other), Key::None };
+                }
+                state = transition.state;
+            }
+        }
+
+        // A control character aborts a sequence and is decoded as if no sequence was started
+        for (size_t state = 1; state < table.stateCount; state++) {
+            for (size_t characterClass = 0; characterClass < table.classCount; characterClass++) {
+                Transition& transition = table.transitions[state][characterClass];
+                if (isControl(classCharacters[characterClass]) && transition.key == Key::Character)
+                    transition = table.transitions[s_idle][characterClass];
+            }
+        }
+
+        return table;
+    }
+
+private:
+    static constexpr bool isControl(unsigned char character) { return character < 0x20 || character >= 0x7f; }
+
+    static constexpr Transition defaultTransition(StateKind kind, unsigned char character)
+    {
+        if (kind == StateKind::Idle || isControl(character))
+            return { s_idle, Key::Character }; // control characters within a sequence are replaced when the table is done
+        if (kind == StateKind::ControlSequence || kind == StateKind::Skip)
+            return { character < 0x40 ? s_skip : s_idle, Key::None };
+
+        return { s_idle, Key::None }; // unknown keys are ignored
+    }
+};
+
+/// @brief Decodes ANSI/VT100 key sequences using a transition table generated at compile time
+///
+/// Every character is decoded by a single table lookup without allocating. Unknown control sequences
+/// are skipped until their final character, and a control character received within a sequence
+/// aborts the sequence and is decoded as if no sequence was started.
+class KeyDecoder {
+public:
+    /// @brief Decodes a received character
+    /// @param character The received character
+    /// @return The key of a completed sequence, Key::None if the character was part of a sequence or Key::Character
+    constexpr Key decode(char character)
+    {
+        const auto& transition = s_table.transitions[m_state][s_table.classes[static_cast<unsigned char>(character)]];
+        m_state = transition.state;
+        return transition.key;
+    }
+
+    /// @brief Checks if a key sequence has been started but not completed yet
+    constexpr bool pending() const { return m_state != KeyTable::s_idle; }
+
+private:
+    static constexpr auto s_tableSize { KeyTable::build<KeyTable::s_maxStates, KeyTable::s_maxClasses>() };
+    static constexpr auto s_table { KeyTable::build<s_tableSize.stateCount, s_tableSize.classCount>() };
+    static_assert(s_table.stateCount <= UINT8_MAX);
+
+    uint8_t m_state { KeyTable::s_idle };
+};
+
+/// @brief The default output sink writing to the functions set by setWrite() or setPrint()
+///
+/// An output sink is called with the data and its size. A sink can also take a flag telling that the
+/// data is terminated (to avoid copying it), and have a flush() function called after buffered output
+/// has been written.
+class FunctionSink {
+public:
+    /// @brief Sets the print function to be used
+    /// @param printFunction The print function receiving terminated text
+    void setPrint(std::function<void(const char*)> printFunction) { m_printFunction = std::move(printFunction); }
+
+    /// @brief Sets the write function to be used instead of the print function
+    /// @param writeFunction The write function receiving the data and its size
+    void setWrite(std::function<void(const char*, size_t)> writeFunction) { m_writeFunction = std::move(writeFunction); }
+
+    /// @brief Sets the function called after buffered output has been written
+    /// @param flushFunction The flush function to be used (e.g. to push out a transport packet)
+    void setFlush(std::function<void()> flushFunction) { m_flushFunction = std::move(flushFunction); }
+
+    void operator()(const char* data, size_t size, bool terminated = false) const
+    {
+        if (m_writeFunction)
+            m_writeFunction(data, size);
+        else if (m_printFunction) {
+            // The print function needs terminated text so copy it in chunks unless it is already terminated
+            if (terminated)
+                return m_printFunction(data);
+
+            std::array<char, s_printChunkSize + 1> chunk;
+            while (size) {
+                size_t chunkSize = std::min(size, s_printChunkSize);
+                std::copy_n(data, chunkSize, chunk.begin());
+                chunk[chunkSize] = '\0';
+                m_printFunction(chunk.data());
+                data += chunkSize;
+                size -= chunkSize;
+            }
+        }
+    }
+
+    void flush() const
+    {
+        if (m_flushFunction)
+            m_flushFunction();
+    }
+
+private:
+    static constexpr size_t s_printChunkSize { 32 };
+
+    std::function<void(const char*)> m_printFunction;
+    std::function<void(const char*, size_t)> m_writeFunction;
+    std::function<void()> m_flushFunction;
+};
+
+/// @brief The shell
+/// @tparam TConfig The configuration of the shell
+/// @tparam TSink The output sink, which can be a type calling the output directly so it can be inlined
+template <Config TConfig, typename TSink = FunctionSink>
+class Yash {
+public:
+    /// @brief Constructor
+    /// @param commandTable The command table, which can be a constexpr array with the commands sorted by name (or
+    /// a table shared by several shells)
+    /// @param sink The output sink to be used
+    constexpr Yash(const CommandTable& commandTable, TSink sink = {})
+        : m_commands(commandTable.commands())
+        , m_sink(std::move(sink))
+        , m_allCommandsSizeAlignment(commandTable.nameAlignment())
+    {
+    }
+
+    ~Yash()
+    {
+        // Let a running command clean up (without printing as the output might be gone)
+        if constexpr (s_async) {
+            if (m_async.function) {
+                m_async.state.cancelled = true;
+                m_async.function({ m_commandArgs.begin(), m_async.argsSize }, m_async.state);
+            }
+        }
+    }
+
+    /// @brief Sets the print function to be used
+    /// @param print The print funcion to be used
+    void setPrint(std::function<void(const char*)> printFunction)
+        requires std::is_same_v<TSink, FunctionSink>
+    {
+        m_sink.setPrint(std::move(printFunction));
+    }
+
+    /// @brief Sets the write function to be used instead of the print function
+    /// @param writeFunction The write function receiving the data and its size
+    void setWrite(std::function<void(const char*, size_t)> writeFunction)
+        requires std::is_same_v<TSink, FunctionSink>
+    {
+        m_sink.setWrite(std::move(writeFunction));
+    }
+
+    /// @brief Sets the function called after buffered output has been written
+    /// @param flushFunction The flush function to be used (e.g. to push out a transport packet)
+    void setFlush(std::function<void()> flushFunction)
+        requires std::is_same_v<TSink, FunctionSink>
+    {
+        m_sink.setFlush(std::move(flushFunction));
+    }
+
+    /// @brief Gets the output sink
+    /// @return A reference to the output sink
+    TSink& sink() { return m_sink; }
+
+    /// @brief Prints the prompt (e.g. when a session has been opened)
+    void printPrompt()
+    {
+        print(m_prompt.c_str());
+        flush();
+    }
+
+    /// @brief Prints the specified text using the output sink
+    /// @param text The text to be printed
+    void print(const char* text) { write(text, std::strlen(text), true); }
+
+    /// @brief Gets an output writing and formatting through the shell (which is also passed to commands)
+    /// @return The output
+    Output output()
+    {
+        auto writeFunction = [](void* context, const char* data, size_t size) { static_cast<Yash*>(context)->write(data, size); };
+        if constexpr (TConfig.outputBufferSize >= 2)
+            return { this, writeFunction, [](void* context, size_t written) { return static_cast<Yash*>(context)->outputSpace(written); } };
+        else
+            return { this, writeFunction };
+    }
+
+    /// @brief Writes any buffered output using the output sink
+    void flush()
+    {
+        if constexpr (s_outputBuffer) {
+            if (!m_output.size)
+                return;
+
+            m_output.data[m_output.size] = '\0'; // a sink might need a terminated string
+            emit(m_output.data.data(), m_output.size, true);
+            m_output.size = 0;
+
+            if constexpr (requires { m_sink.flush(); })
+                m_sink.flush();
+        }
+    }
+
+    /// @brief Sets the storage used for storing the command history persistently
+    /// @param storage The storage to be used
+    ///
+    /// The stored history is first read when the history is used so it does not delay the prompt.
+    void setHistoryStorage(HistoryStorage storage)
+        requires(TConfig.commandHistorySize > 0)
+    {
+        m_history.storage = storage;
+        m_history.storageLoaded = false;
+    }
+
+    /// @brief Sets the name of the shell prompt
+    /// @param prompt A string with the name to be used
+    void setPrompt(std::string_view prompt) { m_prompt.assign(prompt); }
+
+    /// @brief Sets a received character on the shell
+    /// @param character The character to be set
+    void setCharacter(char character)
+    {
+        processCharacter(character);
+        flush();
+    }
+
+    /// @brief Sets a number of received characters on the shell
+    /// @param characters The characters to be set (e.g. a pasted line or multiple commands)
+    ///
+    /// The changes of the input line are not echoed one by one. Instead the part of the input line which
+    /// changed is written once when all characters have been handled, or when a command is run or completed.
+    void setCharacters(std::span<const char> characters)
+    {
+        m_burst = true;
+        for (char character : characters)
+            processCharacter(character);
+        m_burst = false;
+
+        renderInput();
+        flush();
+    }
+
+    /// @brief Feeds a string of received characters to the shell
+    /// @param characters The characters to be set
+    void feed(std::string_view characters) { setCharacters({ characters.data(), characters.size() }); }
+
+    /// @brief Gets the input queue where characters can be pushed from an interrupt or another thread
+    /// @return A reference to the input queue
+    InputQueue<TConfig.inputQueueSize>& inputQueue()
+        requires(TConfig.inputQueueSize > 0)
+    {
+        return m_inputQueue;
+    }
+
+    /// @brief Handles the characters pushed to the input queue and steps a running asynchronous command
+    /// @return The number of characters handled
+    ///
+    /// The characters are handled in batches like characters set by setCharacters(). Characters pushed
+    /// while polling are handled by the next poll so a busy producer cannot keep the task polling.
+    size_t poll()
+    {
+        size_t size { 0 };
+        if constexpr (s_txQueue) {
+            if (txPaused())
+                return size;
+        }
+
+        if constexpr (TConfig.inputQueueSize > 0) {
+            std::array<char, std::min<size_t>(TConfig.inputQueueSize, s_inputBatchSize)> characters;
+            size = m_inputQueue.size();
+            for (size_t remaining = size; remaining;) {
+                size_t popped = m_inputQueue.pop({ characters.data(), std::min(remaining, characters.size()) });
+                setCharacters({ characters.data(), popped });
+                remaining -= popped;
+            }
+        }
+
+        if constexpr (s_async) {
+            if (m_async.function && stepCommand() && runChain(m_job.chain)) {
+                print(m_prompt.c_str());
+                setTypeAhead(); // the input typed ahead while the command was running
+            }
+        }
+
+        flush();
+        return size;
+    }
+
+    /// @brief Checks if an asynchronous command is running (and poll() should be called until it is done)
+    bool busy() const
+    {
+        if constexpr (s_async)
+            return m_async.function != nullptr;
+        else
+            return false;
+    }
+
+    /// @brief Enters the RPC mode where command lines are received in request frames and the output in response frames (see RpcFrame)
+    /// @return False if a command is running
+    ///
+    /// The mode is also entered when RpcFrame::s_magic is received at the start of a line, and it is left when a
+    /// request with an empty payload is received. The line editor is not used in the mode and the input line is
+    /// cleared when entering it.
+    bool enterRpcMode()
+        requires(TConfig.rpcFrameSize > 0)
+    {
+        if (busy())
+            return false;
+
+        flush();
+        m_rpc.active = true;
+        m_rpc.decoder.reset();
+        m_inputCommand.clear();
+        m_position = 0;
+        return true;
+    }
+
+    /// @brief Leaves the RPC mode and prints the prompt
+    void exitRpcMode()
+        requires(TConfig.rpcFrameSize > 0)
+    {
+        if (!std::exchange(m_rpc.active, false))
+            return;
+
+        print(m_prompt.c_str());
+        flush();
+    }
+
+    /// @brief Checks if the shell is in the RPC mode
+    bool rpcMode() const
+        requires(TConfig.rpcFrameSize > 0)
+    {
+        return m_rpc.active;
+    }
+
+    /// @brief Writes the queued output to a non-blocking sink which can accept more (e.g. when a DMA transfer is done)
+    ///
+    /// It should be called from the task running the shell. The input typed while the input was paused is
+    /// handled when the queue is below the txHighWater of the Config again.
+    void txReady()
+        requires(TConfig.txQueueSize > 0)
+    {
+        drainTx();
+        if (!busy() && !txPaused())
+            setTypeAhead();
+    }
+
+    /// @brief Gets the number of bytes in the transmit queue
+    size_t txQueued() const
+        requires(TConfig.txQueueSize > 0)
+    {
+        return m_tx.size;
+    }
+
+    /// @brief Checks if the input is paused because the transmit queue is above the txHighWater of the Config
+    ///
+    /// Characters set while the input is paused are buffered (up to the typeAheadSize of the Config), while
+    /// poll() leaves them in the input queue and does not step a running asynchronous command.
+    bool txPaused() const
+        requires(TConfig.txQueueSize > 0)
+    {
+        return m_tx.size > TConfig.txHighWater;
+    }
+
+    /// @brief Gets the number of bytes dropped because the transmit queue was full
+    size_t txDropped() const
+        requires(TConfig.txQueueSize > 0)
+    {
+        return m_tx.dropped;
+    }
+
+    /// @brief Gets the status of the last command run (see Status)
+    int status() const { return m_status; }
+
+    /// @brief Sets the clock used by the time built-in and the latency statistics
+    /// @param clock The function returning a monotonic time in microseconds
+    void setClock(ClockFunction clock)
+        requires(TConfig.chaining || TConfig.statisticsSize > 0)
+    {
+        m_clock = clock;
+    }
+
+    /// @brief Gets the invocation statistics of the commands (which are also printed by the stats built-in)
+    /// @return The statistics indexed like the command table (up to the statisticsSize of the Config)
+    std::span<const CommandStatistics> statistics() const
+        requires(TConfig.statisticsSize > 0)
+    {
+        return { m_statistics.commands.data(), std::min(m_statistics.commands.size(), m_commands.size()) };
+    }
+
+    /// @brief Clears the invocation statistics of the commands
+    void resetStatistics()
+        requires(TConfig.statisticsSize > 0)
+    {
+        m_statistics.commands.fill({});
+    }
+
+    /// @brief Runs a script of newline separated commands without echoing or rendering the input
+    /// @param script The commands to be run, where blank lines and lines starting with a '#' are skipped
+    /// @param stopOnFailure True if the script should stop at the first failed line
+    /// @return The number of commands run and the failed lines
+    ///
+    /// The commands are looked up directly and are not added to the history, and the input line being
+    /// edited is kept. Asynchronous commands are stepped until they are done before the next line is run.
+    /// A line fails if the status of its (last) command is not Success, and nothing is run while an
+    /// asynchronous command is running (which is reported as a failure).
+    ScriptResult runScript(std::string_view script, bool stopOnFailure = false)
+    {
+        return runScriptLines(std::span<const char> { script.data(), script.size() }, stopOnFailure);
+    }
+
+    /// @brief Runs a script like runScript() but tokenizes the lines in place instead of copying them
+    /// @param script The commands to be run, which are overwritten (e.g. a script file read into a buffer)
+    /// @param stopOnFailure True if the script should stop at the first failed line
+    /// @return The number of commands run and the failed lines
+    ScriptResult runScriptInPlace(std::span<char> script, bool stopOnFailure = false)
+    {
+        return runScriptLines(script, stopOnFailure);
+    }
+
+private:
+    void processCharacter(char character)
+    {
+        if constexpr (s_rpc) {
+            if (m_rpc.active)
+                return processRpcCharacter(character);
+        }
+
+        if constexpr (s_async) {
+            if (m_async.function)
+                return processTypeAhead(character);
+        }
+
+        if constexpr (s_txQueue) {
+            if (txPaused()) {
+                m_typeAhead.push_back(character); // characters are dropped when the buffer is full
+                return;
+            }
+        }
+
+        if constexpr (s_rpc) {
+            if (matchRpcMagic(character))
+                return;
+        }
+
+        bool tabPending = std::exchange(m_tabPending, false); // the candidates are listed on a double Tab
+
+        if constexpr (s_history) {
+            if (m_history.searchActive && processSearchCharacter(character))
+                return;
+        }
+
+        if constexpr (TConfig.keySequences) {
+            Key key = m_keyDecoder.decode(character);
+            if (key != Key::Character)
+                return processKey(key);
+        }
+
+        switch (character) {
+        case '\n':
+        case '\r':
+            renderInput();
+            print("\r\n");
+            if (!m_inputCommand.empty()) {
+                // Only add to history if so is allowed (before the arguments are tokenized in place)
+                if constexpr (s_history) {
+                    loadHistory();
+                    if (m_history.entries.push(m_inputCommand))
+                        storeHistory(m_inputCommand);
+                    m_history.age = 0;
+                }
+
+                runCommand();
+                m_inputCommand.clear();
+            } else
+                print(m_prompt.c_str());
+            m_position = m_inputCommand.length();
+            break;
+        case EndOfText:
+            m_inputCommand.clear();
+            echoInputCommand();
+            m_position = m_inputCommand.length();
+            break;
+        case Del:
+        case Backspace:
+            if (m_position)
+                eraseBefore(m_position - 1);
+            break;
+        case ReverseSearch:
+            if constexpr (s_history) {
+                loadHistory();
+                m_history.searchActive = true;
+                m_history.searchFailed = false;
+                m_history.searchQuery.clear();
+                m_history.searchAge = 0;
+                echoSearch();
+            }
+            break;
+        case Tab:
+            if constexpr (TConfig.completion) {
+                renderInput();
+                completeInput(tabPending);
+            }
+            break;
+        default:
+            // Control characters are ignored when they are not decoded as keys
+            if constexpr (!TConfig.keySequences) {
+                if (static_cast<unsigned char>(character) < ' ')
+                    break;
+            }
+
+            // Characters are ignored when the input line is full
+            if (!m_inputCommand.insert(m_position, character))
+                break;
+
+            if (++m_position != m_inputCommand.length())
+                echoTail(m_position - 1, false);
+            else if (!deferEcho(m_position - 1, m_position - 1, false))
+                printCharacter(character);
+            break;
+        }
+    }
+
+    void processKey(Key key)
+    {
+        if constexpr (s_history) {
+            if (key == Key::Up || key == Key::Down)
+                return processHistoryKey(key);
+        }
+
+        if constexpr (TConfig.editing)
+            processEditingKey(key);
+    }
+
+    void processHistoryKey(Key key)
+        requires(TConfig.commandHistorySize > 0)
+    {
+        switch (key) {
+        case Key::Up:
+            loadHistory();
+            if (m_history.age < m_history.entries.size()) {
+                m_inputCommand.assign(m_history.entries.at(m_history.age++));
+                echoInputCommand();
+                m_position = m_inputCommand.length();
+            }
+            break;
+        case Key::Down:
+            if (m_history.age) {
+                if (--m_history.age) {
+                    m_inputCommand.assign(m_history.entries.at(m_history.age - 1));
+                } else {
+                    m_inputCommand.clear();
+                }
+                echoInputCommand();
+                m_position = m_inputCommand.length();
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    void processEditingKey(Key key)
+        requires(TConfig.editing)
+    {
+        switch (key) {
+        case Key::Right:
+            if (m_position != m_inputCommand.length())
+                moveCursor(m_position + 1);
+            break;
+        case Key::Left:
+            if (m_position)
+                moveCursor(m_position - 1);
+            break;
+        case Key::Home:
+            moveCursor(0);
+            break;
+        case Key::End:
+            moveCursor(m_inputCommand.length());
+            break;
+        case Key::Delete:
+            if (m_position != m_inputCommand.length()) {
+                m_inputCommand.erase(m_position);
+                echoTail(m_position, true);
+            }
+            break;
+        case Key::WordRight:
+            moveCursor(nextWordPosition());
+            break;
+        case Key::WordLeft:
+            moveCursor(previousWordPosition());
+            break;
+        case Key::DeleteToEnd:
+            if (m_position != m_inputCommand.length()) {
+                m_inputCommand.erase(m_position, m_inputCommand.length() - m_position);
+                echoTail(m_position, true);
+            }
+            break;
+        case Key::DeleteToStart:
+            eraseBefore(0);
+            break;
+        case Key::DeleteWordLeft:
+            eraseBefore(previousWordPosition());
+            break;
+        default:
+            break;
+        }
+    }
+
+    /// @brief Matches the received characters with the magic sequence entering the RPC mode
+    /// @param character The character received
+    /// @return True if the character was part of the magic sequence (so it should not be handled)
+    ///
+    /// The sequence is only matched at the start of a line, so typed input is never held back.
+    bool matchRpcMagic(char character)
+    {
+        if (!m_rpc.magicSize && !m_inputCommand.empty())
+            return character == RpcFrame::s_magic[0]; // the control character is ignored within a line
+
+        if (character == RpcFrame::s_magic[m_rpc.magicSize]) {
+            if (++m_rpc.magicSize == RpcFrame::s_magic.size()) {
+                m_rpc.magicSize = 0;
+                enterRpcMode();
+            }
+            return true;
+        }
+
+        // Handle the characters held back while matching (where the first is an ignored control character)
+        size_t magicSize = std::exchange(m_rpc.magicSize, 0);
+        for (size_t index = 1; index < magicSize; index++)
+            processCharacter(RpcFrame::s_magic[index]);
+
+        if (character != RpcFrame::s_magic[0])
+            return false;
+
+        m_rpc.magicSize = 1;
+        return true;
+    }
+
+    /// @brief Handles a character received in the RPC mode
+    void processRpcCharacter(char character)
+    {
+        switch (m_rpc.decoder.push(character)) {
+        case RpcDecoder<TConfig.maxCommandLength>::Result::Pending:
+            break;
+        case RpcDecoder<TConfig.maxCommandLength>::Result::Invalid:
+            m_rpc.sequence = m_rpc.decoder.frame().sequence;
+            sendRpcFrame(RpcInvalidFrame);
+            break;
+        case RpcDecoder<TConfig.maxCommandLength>::Result::Frame:
+            runRpcRequest(m_rpc.decoder.frame());
+            break;
+        }
+    }
+
+    /// @brief Runs the command line of a request frame and sends its output and status in response frames
+    void runRpcRequest(const RpcFrame& request)
+    {
+        m_rpc.sequence = request.sequence;
+        if (request.payload.empty()) {
+            sendRpcFrame(Success);
+            return exitRpcMode();
+        }
+
+        // The command line is run like a line of a script (where asynchronous commands are stepped until they are done)
+        m_job.script = true;
+        m_status = Success;
+        runScriptLine(std::span<const char> { request.payload.data(), request.payload.size() });
+        m_job.script = false;
+        sendRpcFrame(rpcStatus(m_status));
+    }
+
+    /// @brief Adds output to the response frame (without carriage returns) and sends the frame when it is full
+    void writeRpc(const char* data, size_t size)
+    {
+        for (const char* end = data + size; data != end;) {
+            if (*data == '\r') {
+                data++;
+                continue;
+            }
+
+            // A full frame is only sent when there is more output so the last frame of a command holds output
+            if (m_rpc.size == TConfig.rpcFrameSize)
+                sendRpcFrame(RpcOutput);
+
+            size_t chunkSize = std::min(static_cast<size_t>(std::find(data, end, '\r') - data), TConfig.rpcFrameSize - m_rpc.size);
+            std::memcpy(m_rpc.frame.data() + RpcFrame::s_headerSize + m_rpc.size, data, chunkSize);
+            m_rpc.size += chunkSize;
+            data += chunkSize;
+        }
+    }
+
+    /// @brief Sends the response frame with the output added
+    /// @param status The status of the frame (a status of a command or a RpcStatus)
+    void sendRpcFrame(uint8_t status)
+    {
+        std::span<char> frame { m_rpc.frame.data(), m_rpc.size + RpcFrame::s_overhead };
+        RpcFrame::writeHeader(frame, m_rpc.size, m_rpc.sequence, status);
+        RpcFrame::writeCrc(frame);
+        emit(frame.data(), frame.size(), false);
+        m_rpc.size = 0;
+
+        if constexpr (requires { m_sink.flush(); }) {
+            if (status != RpcOutput)
+                m_sink.flush();
+        }
+    }
+
+    /// @brief Handles the characters typed ahead (and clears them)
+    void setTypeAhead()
+        requires(TConfig.asyncCommands || TConfig.txQueueSize > 0)
+    {
+        if (m_typeAhead.empty())
+            return;
+
+        FixedString<TConfig.typeAheadSize> typeAhead { m_typeAhead };
+        m_typeAhead.clear();
+        setCharacters({ typeAhead.data(), typeAhead.size() });
+    }
+
+    /// @brief Handles a character received while an asynchronous command is running
+    void processTypeAhead(char character)
+        requires(TConfig.asyncCommands)
+    {
+        if (character != EndOfText) {
+            m_typeAhead.push_back(character); // characters are dropped when the buffer is full
+            return;
+        }
+
+        // Cancel the command, the commands chained after it and the input typed ahead
+        m_async.state.cancelled = true;
+        stepCommand();
+        m_job.chain = {};
+        m_typeAhead.clear();
+        print("^C\r\n");
+        print(m_prompt.c_str());
+    }
+
+    /// @brief Does a step of the running asynchronous command
+    /// @return True if the command is done (or was cancelled)
+    bool stepCommand()
+        requires(TConfig.asyncCommands)
+    {
+        CommandState& state = m_async.state;
+        bool done = m_async.function({ m_commandArgs.begin(), m_async.argsSize }, state) || state.cancelled;
+        state.step++;
+        if (!done)
+            return false;
+
+        m_status = state.cancelled ? Cancelled : state.status;
+        if constexpr (s_statistics)
+            recordStatistics(*m_job.command, m_statistics.start);
+
+        if (!state.cancelled && nextIteration()) {
+            // Start the next iteration of a repeated command
+            state = { .output = output() };
+            if constexpr (s_statistics)
+                m_statistics.start = statisticsStart();
+            return false;
+        }
+
+        m_async.function = nullptr;
+        return true;
+    }
+
+    /// @brief Erases the input from a position up to the cursor
+    void eraseBefore(size_t position)
+    {
+        if (position == m_position)
+            return;
+
+        m_inputCommand.erase(position, m_position - position);
+        echoCursorMove(m_position, position);
+        m_position = position;
+        echoTail(m_position, true);
+    }
+
+    enum Character {
+        EndOfText = 3,
+        Bell = 7,
+        Backspace = 8,
+        Tab = 9,
+        ReverseSearch = 18,
+        Esc = 27,
+        Up = 65,
+        Down = 66,
+        Right = 67,
+        Left = 68,
+        LeftBracket = 91,
+        Del = 127,
+    };
+
+    void loadHistory()
+    {
+        if (m_history.storageLoaded || !m_history.storage.read)
+            return;
+
+        m_history.storageLoaded = true;
+
+        // The entries added before the storage was set are newer than the stored entries
+        auto newerEntries = std::exchange(m_history.entries, {});
+        bool valid = readHistoryStorage();
+        for (size_t age = newerEntries.size(); age--;)
+            m_history.entries.push(newerEntries.at(age));
+
+        if (!valid || !newerEntries.empty())
+            rewriteHistoryStorage();
+    }
+
+    /// @brief Adds the stored entries to the history
+    /// @return False if the storage has to be rewritten (e.g. if a partially written entry was found)
+    bool readHistoryStorage()
+    {
+        HistoryStorage& storage = m_history.storage;
+        std::array<char, s_historyHeader.size()> header;
+        if (storage.read(storage.context, 0, header.data(), header.size()) != header.size() || std::string_view { header.data(), header.size() } != s_historyHeader)
+            return false; // nothing (or another version) was stored so start all over
+
+        std::array<char, UINT8_MAX> entry;
+        size_t offset = header.size();
+        unsigned char entrySize;
+        while (storage.read(storage.context, offset, reinterpret_cast<char*>(&entrySize), 1) == 1) {
+            if (storage.read(storage.context, offset + 1, entry.data(), entrySize) != entrySize)
+                return false; // a partially written entry has to be removed before appending new entries
+
+            if (entrySize <= TConfig.maxCommandLength)
+                m_history.entries.push({ entry.data(), entrySize });
+            offset += entrySize + 1;
+        }
+
+        m_history.storageSize = offset;
+        return true;
+    }
+
+    void storeHistory(std::string_view entry)
+    {
+        if (!m_history.storageLoaded || !m_history.storage.append)
+            return;
+
+        // Only rewrite the history once in a while to save writes
+        if (m_history.storageSize + entry.size() + 1 > s_historyStorageMaxSize)
+            return rewriteHistoryStorage();
+
+        appendHistory(entry);
+    }
+
+    void appendHistory(std::string_view entry)
+    {
+        if (entry.size() > std::min<size_t>(TConfig.maxCommandLength, UINT8_MAX))
+            return;
+
+        // Append the size and the entry at once so they are written together
+        std::array<char, TConfig.maxCommandLength + 1> data;
+        data[0] = static_cast<char>(entry.size());
+        std::copy(entry.begin(), entry.end(), data.begin() + 1);
+        m_history.storage.append(m_history.storage.context, data.data(), entry.size() + 1);
+        m_history.storageSize += entry.size() + 1;
+    }
+
+    void rewriteHistoryStorage()
+    {
+        if (!m_history.storage.clear || !m_history.storage.append)
+            return;
+
+        m_history.storage.clear(m_history.storage.context);
+        m_history.storage.append(m_history.storage.context, s_historyHeader.data(), s_historyHeader.size());
+        m_history.storageSize = s_historyHeader.size();
+
+        for (size_t age = m_history.entries.size(); age--;)
+            appendHistory(m_history.entries.at(age));
+    }
+
+    /// @brief The operators chaining commands
+    enum class ChainOperator : uint8_t {
+        Sequence, // ; runs the next command after the previous one
+        And, // && runs the next command if the previous one succeeded
+        Or, // || runs the next command if the previous one failed
+    };
+
+    /// @brief The repetition and timing of a command set by the repeat and time built-ins
+    struct Repetition {
+        size_t count { 1 }; // The number of times the command is run
+        size_t iteration { 0 }; // The number of times the command has been run
+        bool timeEach { false }; // Print the time of each iteration (repeat N time <command>)
+        bool timeAll { false }; // Print the time of all iterations (time repeat N <command>)
+        uint64_t start { 0 };
+        uint64_t iterationStart { 0 };
+    };
+
+    void runCommand()
+    {
+        m_job.chainOperator = ChainOperator::Sequence;
+        if (runChain({ m_inputCommand.data(), m_inputCommand.size() }))
+            print(m_prompt.c_str());
+    }
+
+    /// @brief Runs the chained commands of an input until they are done or an asynchronous command is started
+    /// @param input The commands, which are tokenized in place
+    /// @return True if the commands are done, otherwise the rest of them are run when the asynchronous command is done
+    bool runChain(std::span<char> input)
+    {
+        while (true) {
+            ChainOperator chainOperator = m_job.chainOperator;
+            size_t end { input.size() };
+            size_t operatorSize { 0 };
+            if constexpr (TConfig.chaining)
+                end = findChainOperator(input, m_job.chainOperator, operatorSize);
+
+            // The command is skipped (keeping the status) if the previous status does not match the operator
+            m_job.chain = input.subspan(end + operatorSize);
+            bool run = chainOperator == ChainOperator::Sequence || (chainOperator == ChainOperator::And) == (m_status == Success);
+            if (run && !runChainedCommand(input.first(end)))
+                return false;
+
+            if (m_job.chain.empty())
+                return true;
+
+            input = m_job.chain;
+        }
+    }
+
+    /// @brief The characters which are operators, quotes or escapes of chained commands
+    static constexpr auto s_chainCharacters = [] {
+        std::array<bool, 256> characters {};
+        for (char character : std::string_view { ";&|\"\\" })
+            characters[static_cast<unsigned char>(character)] = true;
+        return characters;
+    }();
+
+    /// @brief Finds the first operator chaining commands which is not quoted or escaped
+    /// @param input The input to search
+    /// @param chainOperator Set to the operator found (or ChainOperator::Sequence if none was found)
+    /// @param operatorSize Set to the size of the operator found (or 0 if none was found)
+    /// @return The position of the operator or the size of the input if none was found
+    static constexpr size_t findChainOperator(std::span<const char> input, ChainOperator& chainOperator, size_t& operatorSize)
+    {
+        // Most inputs have no operators, quotes or escapes so they are skipped quickly
+        size_t start { 0 };
+        while (start < input.size() && !s_chainCharacters[static_cast<unsigned char>(input[start])])
+            start++;
+
+        bool quoted { false };
+        for (size_t position = start; position < input.size(); position++) {
+            char character = input[position];
+            if (character == '\\')
+                position++;
+            else if (character == '"')
+                quoted = !quoted;
+            else if (!quoted && character == ';') {
+                chainOperator = ChainOperator::Sequence;
+                operatorSize = 1;
+                return position;
+            } else if (!quoted && (character == '&' || character == '|') && position + 1 < input.size() && input[position + 1] == character) {
+                chainOperator = character == '&' ? ChainOperator::And : ChainOperator::Or;
+                operatorSize = 2;
+                return position;
+            }
+        }
+
+        chainOperator = ChainOperator::Sequence;
+        operatorSize = 0;
+        return input.size();
+    }
+
+    /// @brief Runs one of the chained commands (including the built-ins before it)
+    /// @param input The command, which is tokenized in place
+    /// @return True if the command is done, false if an asynchronous command was started
+    bool runChainedCommand(std::span<char> input)
+    {
+        while (!input.empty() && input.front() == s_commandDelimiter[0])
+            input = input.subspan(1);
+        if (input.empty())
+            return true;
+
+        // The commands of the command table take precedence over the built-ins
+        const Command* command = findCommand({ input.data(), input.size() }, m_job.command, m_job.commandIsPrefix);
+        bool builtins { false };
+        if constexpr (TConfig.chaining) {
+            m_repetition = {};
+            while (!command && parseBuiltin(input)) {
+                builtins = true;
+                command = findCommand({ input.data(), input.size() }, m_job.command, m_job.commandIsPrefix);
+            }
+        }
+
+        if (!command) {
+            if (input.empty()) {
+                m_status = InvalidArguments; // the usage of the built-in has been printed
+                return true;
+            }
+
+            if constexpr (s_statistics) {
+                if (runStatisticsBuiltin({ input.data(), input.size() }))
+                    return true;
+            }
+
+            m_status = NotFound;
+            if (m_job.script || !TConfig.help) {
+                print(s_commandNotFound);
+                write(input.data(), input.size());
+                print("\r\n");
+            } else if constexpr (TConfig.help)
+                printMatchingCommands({ input.data(), input.size() });
+            return true;
+        }
+
+        if (command != m_job.command) {
+            m_job.command = command;
+            m_job.commandIsPrefix = command + 1 != m_commands.data() + m_commands.size() && (command + 1)->name.starts_with(command->name);
+        }
+        m_job.commands++;
+
+        size_t argsSize = tokenize(input.subspan(command->name.size()), m_commandArgs);
+        if (argsSize > m_commandArgs.size()) {
+            print(s_tooManyArguments);
+            argsSize = m_commandArgs.size();
+        }
+
+        CommandArgs args { m_commandArgs.data(), argsSize };
+        if constexpr (TConfig.chaining) {
+            Repetition& repetition = m_repetition;
+            if (builtins && (repetition.timeEach || repetition.timeAll))
+                repetition.start = repetition.iterationStart = m_clock();
+        }
+
+        if constexpr (s_async) {
+            if (args.size() >= command->requiredArguments && command->kind == CommandKind::Async) {
+                // The arguments are views of the input line which is not edited until the command is done
+                flush(); // the command might print without using the shell
+                m_async = { command->asyncFunction, args.size(), { .output = output() } };
+                if constexpr (s_statistics)
+                    m_statistics.start = statisticsStart();
+                return stepCommand();
+            }
+        }
+
+        // Commands which are not repeated or timed by the built-ins are only called once
+        do {
+            uint64_t start = statisticsStart();
+            m_status = callCommand(*command, args);
+            recordStatistics(*command, start);
+        } while (builtins && nextIteration());
+
+        return true;
+    }
+
+    /// @brief Parses a built-in at the beginning of an input (repeat <count> or time)
+    /// @param input The input, which is set to the rest of the input following the built-in (or emptied if it was invalid)
+    /// @return True if the input started with a built-in
+    bool parseBuiltin(std::span<char>& input)
+    {
+        // Most commands are not built-ins so the first character rules them out
+        if (input.empty() || (input.front() != s_repeatBuiltin.front() && input.front() != s_timeBuiltin.front()))
+            return false;
+
+        std::string_view text { input.data(), input.size() };
+        std::string_view word = text.substr(0, text.find(s_commandDelimiter[0]));
+        Repetition& repetition = m_repetition;
+        size_t count { 0 };
+
+        if (word == s_repeatBuiltin) {
+            text.remove_prefix(word.size());
+            text.remove_prefix(std::min(text.find_first_not_of(s_commandDelimiter[0]), text.size()));
+            std::string_view countText = text.substr(0, text.find(s_commandDelimiter[0]));
+            if (!Argument<size_t>::parse(countText, count) || !count) {
+                print(s_repeatUsage);
+                input = {};
+                return true;
+            }
+
+            // Nested repetitions are multiplied and the time of each iteration is printed by a following time
+            repetition.count *= count;
+            word = { word.data(), static_cast<size_t>(countText.data() + countText.size() - word.data()) };
+        } else if (word == s_timeBuiltin) {
+            if (!m_clock)
+                print(s_noClock);
+            else if (repetition.count > 1)
+                repetition.timeEach = true;
+            else
+                repetition.timeAll = true;
+        } else
+            return false;
+
+        input = input.subspan(word.size());
+        while (!input.empty() && input.front() == s_commandDelimiter[0])
+            input = input.subspan(1);
+
+        if (input.empty())
+            print(word.starts_with(s_repeatBuiltin) ? s_repeatUsage : s_timeUsage);
+        return true;
+    }
+
+    /// @brief Ends an iteration of a repeated (or timed) command and prints the time
+    /// @return True if the command should be run again
+    bool nextIteration()
+    {
+        if constexpr (TConfig.chaining) {
+            Repetition& repetition = m_repetition;
+            repetition.iteration++;
+            uint64_t now = repetition.timeEach || repetition.timeAll ? m_clock() : 0;
+            if (repetition.timeEach)
+                printTime(now - repetition.iterationStart, 1);
+
+            if (m_status == Success && repetition.iteration < repetition.count) {
+                if (repetition.timeEach)
+                    repetition.iterationStart = m_clock(); // the time spent printing is not included
+                return true;
+            }
+
+            if (m_status != Success && repetition.count > 1)
+                output().format(s_failedIteration, repetition.iteration);
+            if (repetition.timeAll)
+                printTime(now - repetition.start, repetition.iteration);
+        }
+
+        return false;
+    }
+
+    /// @brief Gets the time a command is started for its latency statistics
+    /// @return The time or 0 if the statistics are disabled or no clock is set
+    uint64_t statisticsStart() const
+    {
+        if constexpr (s_statistics)
+            return m_clock ? m_clock() : 0;
+        else
+            return 0;
+    }
+
+    /// @brief Records a call of a command (with the status of the call) in its statistics
+    /// @param command The command called
+    /// @param start The time the command was started
+    void recordStatistics(const Command& command, uint64_t start)
+    {
+        if constexpr (s_statistics) {
+            size_t index = static_cast<size_t>(&command - m_commands.data());
+            if (index >= m_statistics.commands.size())
+                return;
+
+            CommandStatistics& statistics = m_statistics.commands[index];
+            statistics.calls++;
+            if (m_status != Success)
+                statistics.errors++;
+            if (m_clock)
+                statistics.latency[CommandStatistics::bucket(m_clock() - start)]++;
+        }
+    }
+
+    /// @brief Runs the stats built-in printing (or resetting) the invocation statistics
+    /// @param input The input, which might be the built-in
+    /// @return True if the input was the built-in
+    bool runStatisticsBuiltin(std::string_view input)
+    {
+        std::string_view word = input.substr(0, input.find(s_commandDelimiter[0]));
+        if (word != s_statsBuiltin)
+            return false;
+
+        input.remove_prefix(word.size());
+        input.remove_prefix(std::min(input.find_first_not_of(s_commandDelimiter[0]), input.size()));
+        input = input.substr(0, input.find(s_commandDelimiter[0]));
+
+        m_status = Success;
+        if (input.empty())
+            printStatistics();
+        else if (input == s_statsReset)
+            resetStatistics();
+        else {
+            print(s_statsUsage);
+            m_status = InvalidArguments;
+        }
+
+        return true;
+    }
+
+    /// @brief Prints the statistics of the commands which have been called
+    void printStatistics()
+    {
+        std::span<const CommandStatistics> commandStatistics = statistics();
+        size_t alignmentSize { 0 };
+        for (size_t index = 0; index < commandStatistics.size(); index++) {
+            if (commandStatistics[index].calls)
+                alignmentSize = std::max(alignmentSize, m_commands[index].name.size());
+        }
+
+        for (size_t index = 0; index < commandStatistics.size(); index++) {
+            const CommandStatistics& statistics = commandStatistics[index];
+            if (!statistics.calls)
+                continue;
+
+            printName(m_commands[index].name, alignmentSize);
+            output().format(s_statsCalls, statistics.calls, statistics.errors);
+            for (size_t bucket = 0; bucket < statistics.latency.size(); bucket++) {
+                if (!statistics.latency[bucket])
+                    continue;
+
+                if (bucket + 1 < statistics.latency.size())
+                    output().format(s_statsLatency, uint64_t { 1 } << bucket, statistics.latency[bucket]);
+                else
+                    output().format(s_statsLatencyAbove, uint64_t { 1 } << (bucket - 1), statistics.latency[bucket]);
+            }
+            print("\r\n");
+        }
+    }
+
+    void printTime(uint64_t duration, size_t iterations)
+    {
+        if (iterations == 1)
+            output().format(s_time, duration);
+        else
+            output().format(s_timeIterations, duration, iterations, duration / iterations);
+    }
+
+    /// @brief Calls a (synchronous) command
+    /// @return The status of the command (InvalidArguments if the reason and the usage of the command have been printed)
+    int callCommand(const Command& command, CommandArgs args)
+    {
+        if (args.size() >= command.requiredArguments) {
+            flush(); // the command might print without using the shell
+            switch (command.kind) {
+            case CommandKind::Plain:
+                command.function(args);
+                return Success;
+            case CommandKind::Status:
+                return command.statusFunction(args);
+            case CommandKind::Output: {
+                Output commandOutput = output();
+                command.outputFunction(args, commandOutput);
+                return Success;
+            }
+            case CommandKind::OutputStatus: {
+                Output commandOutput = output();
+                return command.outputStatusFunction(args, commandOutput);
+            }
+            case CommandKind::Async:
+                return Failure; // asynchronous commands are disabled in the Config
+            case CommandKind::Typed:
+                break;
+            }
+
+            Output commandOutput = output();
+            int status { Success };
+            size_t parsed = command.typedFunction(args, commandOutput, status);
+            if (parsed == command.requiredArguments)
+                return status;
+
+            print(s_invalidArgument);
+            write(args[parsed].data(), args[parsed].size());
+            print("\r\n");
+        }
+
+        // Too few (or invalid) arguments so print the description and usage of the command
+        printNameAndDescription(command.name, command.description, command.name.size());
+        printUsage(command);
+        return InvalidArguments;
+    }
+
+    /// @brief The characters ending a line of a script or requiring a search for the chain operators
+    static constexpr auto s_scriptCharacters = [] {
+        std::array<bool, 256> characters = s_chainCharacters;
+        characters[static_cast<unsigned char>('\n')] = true;
+        return characters;
+    }();
+
+    /// @brief Runs the lines of a script (see runScript())
+    /// @tparam TChar The characters of the script, which are tokenized in place unless they are const
+    template <typename TChar>
+    ScriptResult runScriptLines(std::span<TChar> script, bool stopOnFailure)
+    {
+        ScriptResult result;
+        if (busy())
+            return { .failures = 1 };
+
+        m_job.script = true;
+        m_job.commands = 0;
+        for (size_t line = 1; !script.empty(); line++) {
+            // Most lines have no operators, quotes or escapes so the end of the line is found while ruling them out
+            size_t end { 0 };
+            while (end < script.size() && !s_scriptCharacters[static_cast<unsigned char>(script[end])])
+                end++;
+
+            bool chained = end < script.size() && script[end] != '\n';
+            if (chained)
+                end = std::min(std::string_view { script.data(), script.size() }.find('\n', end), script.size());
+
+            if (!runScriptLine(script.first(end), chained, end == script.size())) {
+                if (!result.failures++)
+                    result.failedLine = line;
+                if (stopOnFailure)
+                    break;
+            }
+
+            script = script.subspan(std::min(end + 1, script.size()));
+        }
+
+        m_job.script = false;
+        result.commands = m_job.commands;
+        flush();
+        return result;
+    }
+
+    /// @brief Runs a line of a script
+    /// @param line The line to be run, which is tokenized in place unless it is const
+    /// @param chained True if the line might chain commands (otherwise it has no operators, quotes or escapes)
+    /// @param last True if the line is not followed by a newline (so it can not be terminated in place)
+    /// @return True if the line is empty, a comment or commands which succeeded
+    template <typename TChar>
+    bool runScriptLine(std::span<TChar> line, bool chained = true, bool last = true)
+    {
+        if (!line.empty() && line.back() == '\r')
+            line = line.first(line.size() - 1);
+
+        while (!line.empty() && (line.front() == ' ' || line.front() == '\t'))
+            line = line.subspan(1);
+        if (line.empty() || line.front() == s_scriptComment)
+            return true;
+
+        if (line.size() > TConfig.maxCommandLength) {
+            print(s_lineTooLong);
+            return false;
+        }
+
+        // A line is copied unless it can be tokenized in place (and the copy is not initialized first as it is overwritten)
+        std::array<char, TConfig.maxCommandLength + 1> copy;
+        std::span<char> input;
+        if constexpr (!std::is_const_v<TChar>) {
+            if (!last)
+                input = line;
+        }
+        if (input.empty()) {
+            std::copy(line.begin(), line.end(), copy.begin());
+            copy[line.size()] = '\0';
+            input = { copy.data(), line.size() };
+        }
+
+        // Asynchronous commands are stepped until they are done as a script runs to the end
+        m_job.chainOperator = ChainOperator::Sequence;
+        bool done;
+        if (chained)
+            done = runChain(input);
+        else {
+            m_job.chain = {};
+            done = runChainedCommand(input);
+        }
+
+        if constexpr (s_async) {
+            while (!done)
+                done = stepCommand() && runChain(m_job.chain);
+        }
+
+        return m_status == Success;
+    }
+
+    /// @brief Splits the input into tokens in place without copying it
+    /// @param input The input to be tokenized (quotes and escapes are removed and the tokens are terminated)
+    /// @param tokens The span to be filled with views of the tokens
+    /// @return The number of tokens found, which is larger than the span size if the tokens did not fit
+    ///
+    /// Tokens are separated by spaces unless they are in double quotes or escaped by a backslash.
+    static constexpr size_t tokenize(std::span<char> input, std::span<std::string_view> tokens)
+    {
+        constexpr char delimiter { s_commandDelimiter[0] };
+        size_t tokenCount { 0 };
+        char* read = input.data();
+        char* end = read + input.size();
+
+        while (true) {
+            while (read != end && *read == delimiter)
+                read++;
+            if (read == end)
+                break;
+
+            // Most tokens have no quotes or escapes so they are left as they are
+            char* start = read;
+            while (read != end && *read != delimiter && *read != '"' && *read != '\\')
+                read++;
+
+            // Otherwise the rest of the token can only get shorter than the input so it is written in place
+            char* write = read;
+            if (read != end && *read != delimiter) {
+                for (bool quoted { false }; read != end; read++) {
+                    char character = *read;
+                    if (character == '\\' && read + 1 != end)
+                        *write++ = *++read;
+                    else if (character == '"')
+                        quoted = !quoted;
+                    else if (character == delimiter && !quoted)
+                        break;
+                    else
+                        *write++ = character;
+                }
+            }
+
+            if (tokenCount < tokens.size())
+                tokens[tokenCount] = { start, static_cast<size_t>(write - start) };
+            tokenCount++;
+
+            if (read != end)
+                read++; // skip the delimiter ending the token
+
+            // Terminate the token which is safe as the input is followed by either a delimiter or a terminator
+            *write = '\0';
+        }
+
+        return tokenCount;
+    }
+
+    /// @brief Finds the commands with a name starting with the given prefix
+    /// @param prefix The prefix to search for
+    /// @param commands The (sorted) commands to search in
+    /// @param offset The number of characters of the prefix which all the commands are known to start with
+    /// @return The range of matching commands (which might be empty)
+    static constexpr CommandSpan findCommands(std::string_view prefix, CommandSpan commands, size_t offset = 0)
+    {
+        auto [first, last] = std::equal_range(commands.begin(), commands.end(), prefix, CommandPrefixCompare { prefix.size(), offset });
+        return { first, last };
+    }
+
+    /// @brief Checks if the name of a command matches the whole words at the beginning of the input
+    static constexpr bool matchesCommand(std::string_view input, const Command& command)
+    {
+        return input.starts_with(command.name) && (input.size() == command.name.size() || input[command.name.size()] == *s_commandDelimiter);
+    }
+
+    /// @brief Finds the command with the longest name matching the whole words at the beginning of the input
+    /// @param input The input to find the command for
+    /// @param hint A command which is likely to match (e.g. the previous command of a script) or nullptr
+    /// @param hintIsPrefix False if the name of the hint is known not to be the prefix of the next command
+    /// @return A pointer to the command or nullptr if no command matched
+    ///
+    /// Only the hint is checked here (the search is done by the overload below) so it can be inlined where the commands are run.
+    const Command* findCommand(std::string_view input, const Command* hint, bool hintIsPrefix = true) const
+    {
+        // The hint is the command unless a longer matching name is sorted after it (right after the commands
+        // starting with the name, so there is none if the next command does not start with it)
+        if (hint && matchesCommand(input, *hint) && (!hintIsPrefix || hint + 1 == m_commands.data() + m_commands.size() || CommandPrefixCompare::less(input, (hint + 1)->name)))
+            return hint;
+
+        return findCommand(input);
+    }
+
+    /// @brief Finds the command with the longest name matching the whole words at the beginning of the input
+    /// @param input The input to find the command for
+    /// @return A pointer to the command or nullptr if no command matched
+    const Command* findCommand(std::string_view input) const
+    {
+        // The command is usually the last one sorted before the input, as a longer matching name would be sorted after it
+        const Command* last = m_commands.data() + m_commands.size();
+        auto next = std::upper_bound(m_commands.data(), last, input, [](std::string_view input, const Command& command) {
+            return CommandPrefixCompare::less(input, command.name);
+        });
+        if (next != m_commands.data() && matchesCommand(input, *(next - 1)))
+            return next - 1;
+
+        const Command* command { nullptr };
+        std::span<const Command> commands = m_commands;
+        size_t matched { 0 };
+
+        for (size_t position = input.find_first_of(s_commandDelimiter);; position = input.find_first_of(s_commandDelimiter, position + 1)) {
+            std::string_view name = input.substr(0, position);
+
+            // The range can only get smaller the more words we match, and the words already matched are skipped
+            commands = findCommands(name, commands, matched);
+            if (commands.empty())
+                break;
+
+            matched = name.size();
+
+            if (commands.front().name == name)
+                command = &commands.front();
+
+            if (position == std::string_view::npos)
+                break;
+        }
+
+        return command;
+    }
 
-struct Command {
-    const std::string_view name;
-    const std::string_view description;
-    const CommandFunction function;
-    const size_t requiredArguments;
-};
+    /// @brief Adds the output written directly to the output buffer (see Output::format())
+    /// @param written The number of bytes written to the free space of the buffer
+    /// @return The free space of the buffer (which is flushed when less than 2 bytes are free), or none in the RPC mode
+    std::span<char> outputSpace(size_t written)
+    {
+        if constexpr (s_rpc) {
+            if (m_rpc.active)
+                return {};
+        }
 
-struct Config {
-    const size_t maxRequiredArgs; // The maximum amount of arguments provided in a callback
-    const size_t commandHistorySize;
-};
+        m_output.size += written;
+        if (TConfig.outputBufferSize - m_output.size < 2)
+            flush();
+        return { m_output.data.data() + m_output.size, TConfig.outputBufferSize - m_output.size };
+    }
 
-using CommandSpan = const std::span<const Command>;
+    void write(const char* data, size_t size, bool terminated = false)
+    {
+        if constexpr (s_rpc) {
+            if (m_rpc.active)
+                return writeRpc(data, size);
+        }
 
-template <Config TConfig>
-class Yash {
-public:
-    /// @brief Constructor
-    /// @param commands A reference to an array with the commands (can be constexpr if wanted)
-    /// @param commandHistorySize The size of the command history (default 10)
-    constexpr Yash(CommandSpan commands)
-        : m_commands(commands)
-        , m_commandHistoryIndex(m_commandHistory.begin())
-        , m_commandHistorySize(TConfig.commandHistorySize)
-        , m_allCommandsSizeAlignment(std::accumulate(commands.begin(), commands.end(), 0, [](size_t max, const auto& cmd) {
-            std::string_view commandNameSub = cmd.name.substr(0, cmd.name.find_first_of(s_commandDelimiter));
-            return std::max(max, commandNameSub.size());
-        }))
+        if constexpr (s_outputBuffer) {
+            static_cast<void>(terminated); // the buffer is terminated when it is flushed
+            while (size) {
+                if (m_output.size == TConfig.outputBufferSize)
+                    flush(); // the buffer overflowed so write what we have and continue
+
+                size_t chunkSize = std::min(size, TConfig.outputBufferSize - m_output.size);
+                std::memcpy(m_output.data.data() + m_output.size, data, chunkSize);
+                m_output.size += chunkSize;
+                data += chunkSize;
+                size -= chunkSize;
+            }
+        } else
+            emit(data, size, terminated);
+    }
+
+    void emit(const char* data, size_t size, bool terminated)
     {
+        if constexpr (s_txQueue) {
+            static_cast<void>(terminated);
+            if (!m_tx.size) {
+                size_t accepted = m_sink(data, size);
+                data += accepted;
+                size -= accepted;
+            }
+
+            return queueTx(data, size);
+        } else if constexpr (std::is_invocable_v<TSink&, const char*, size_t, bool>)
+            m_sink(data, size, terminated);
+        else
+            m_sink(data, size);
     }
 
-    ~Yash() = default;
+    /// @brief Queues the output not accepted by a non-blocking sink (handling an overflow as set by the Config)
+    void queueTx(const char* data, size_t size)
+    {
+        if (m_tx.truncated) {
+            m_tx.dropped += size;
+            return;
+        }
 
-    /// @brief Sets the print function to be used
-    /// @param print The print funcion to be used
-    void setPrint(std::function<void(const char*)> printFunction) { m_printFunction = std::move(printFunction); }
+        // Room for the marker is kept so it always fits
+        constexpr size_t capacity = TConfig.txQueueSize - (TConfig.txOverflow == TxOverflow::Truncate ? s_truncatedMarker.size() : 0);
+        while (size) {
+            if (m_tx.size == capacity) {
+                if constexpr (TConfig.txOverflow == TxOverflow::Block) {
+                    drainTx();
+                    continue;
+                } else {
+                    if constexpr (TConfig.txOverflow == TxOverflow::Truncate) {
+                        pushTx(s_truncatedMarker.data(), s_truncatedMarker.size());
+                        m_tx.truncated = true;
+                    }
 
-    /// @brief Prints the specified text using the print function
-    /// @param text The text to be printed
-    void print(const char* text) const
+                    m_tx.dropped += size;
+                    return;
+                }
+            }
+
+            size_t chunkSize = std::min(size, capacity - m_tx.size);
+            pushTx(data, chunkSize);
+            data += chunkSize;
+            size -= chunkSize;
+        }
+    }
+
+    void pushTx(const char* data, size_t size)
     {
-        if (m_printFunction)
-            m_printFunction(text);
+        for (size_t index = 0; index < size; index++)
+            m_tx.data[(m_tx.head + m_tx.size + index) % TConfig.txQueueSize] = data[index];
+        m_tx.size += size;
     }
 
-    /// @brief Sets the name of the shell prompt
-    /// @param prompt A string with the name to be used
-    void setPrompt(const std::string& prompt) { m_prompt = prompt; }
+    /// @brief Writes the queued output until the sink does not accept more
+    void drainTx()
+    {
+        while (m_tx.size) {
+            size_t size = std::min(m_tx.size, TConfig.txQueueSize - m_tx.head);
+            size_t accepted = m_sink(m_tx.data.data() + m_tx.head, size);
+            m_tx.head = (m_tx.head + accepted) % TConfig.txQueueSize;
+            m_tx.size -= accepted;
+            if (accepted < size)
+                return;
+        }
 
-    /// @brief Sets a received character on the shell
-    /// @param character The character to be set
-    void setCharacter(char character)
+        m_tx.head = 0;
+        m_tx.truncated = false;
+    }
+
+    void printCharacter(char character)
     {
-        switch (character) {
-        case '\n':
-        case '\r':
-            print("\r\n");
-            if (!m_inputCommand.empty()) {
-                runCommand();
+        const char text[] { character, '\0' };
+        print(text);
+    }
 
-                // Only add to history if so is allowed
-                if (TConfig.commandHistorySize > 0) {
-                    if (m_commandHistory.size() >= m_commandHistorySize)
-                        m_commandHistory.erase(m_commandHistory.begin());
+    /// @brief Checks if echoing the prompt and the input (or the search) is deferred until the input is rendered
+    /// @return True if the echo should be skipped
+    bool deferEcho()
+    {
+        if (m_burst)
+            m_render.pending = m_render.prompt = true;
 
-                    m_commandHistory.push_back(m_inputCommand);
-                    m_inputCommand.clear();
-                    m_commandHistoryIndex = m_commandHistory.end();
-                }
-            } else
-                print(m_prompt.c_str());
-            m_position = m_inputCommand.length();
-            break;
-        case EndOfText:
-            m_inputCommand.clear();
+        return m_burst;
+    }
+
+    /// @brief Checks if echoing a change of the input is deferred until the input is rendered
+    /// @param cursor The position of the cursor before the change
+    /// @param from The first position of the input which changed (or the length of the input if only the cursor moved)
+    /// @param erase True if the input might have gotten shorter
+    /// @return True if the echo should be skipped
+    bool deferEcho(size_t cursor, size_t from, bool erase)
+    {
+        if (!m_burst)
+            return false;
+
+        // The cursor is where the first deferred change left the terminal
+        if (!std::exchange(m_render.pending, true))
+            m_render.cursor = cursor;
+        m_render.from = std::min(m_render.from, from);
+        m_render.erase |= erase;
+        return true;
+    }
+
+    void echo(const char* text)
+    {
+        if (!deferEcho())
+            print(text);
+    }
+
+    void echo(char character)
+    {
+        const char text[] { character, '\0' };
+        echo(text);
+    }
+
+    void echoInputCommand()
+    {
+        if (!deferEcho())
             printInputCommand();
-            m_position = m_inputCommand.length();
-            break;
+    }
+
+    /// @brief Renders the changes of the input deferred while handling a burst of characters
+    void renderInput()
+    {
+        if (!m_render.pending)
+            return;
+
+        Render render = std::exchange(m_render, {});
+        if constexpr (s_history) {
+            if (m_history.searchActive)
+                return printSearch();
+        }
+
+        size_t length = m_inputCommand.length();
+        if (render.prompt) {
+            printInputCommand();
+            printCursorMove(length, m_position);
+            return;
+        }
+
+        // Only the input from the first change is written (usually the characters appended)
+        size_t from = std::min(render.from, length);
+        if (from == length && !render.erase)
+            return printCursorMove(render.cursor, m_position);
+
+        printCursorMove(render.cursor, from);
+        write(m_inputCommand.data() + from, length - from);
+        if (render.erase)
+            print(s_eraseToEndOfLine);
+        printCursorMove(length, m_position);
+    }
+
+    /// @brief Handles a character while searching the history
+    /// @return True if the character was handled, otherwise the search has ended and the character should be handled as usual
+    bool processSearchCharacter(char character)
+    {
+        switch (character) {
+        case ReverseSearch:
+            // Search for an older match
+            if (!m_history.searchQuery.empty() && searchHistory(m_history.searchAge + 1))
+                echoSearchMatch();
+            else if (!m_history.searchFailed) {
+                m_history.searchFailed = true;
+                echoSearch();
+            }
+            return true;
         case Del:
         case Backspace:
-            if (!m_inputCommand.empty()) {
-                if (m_position == m_inputCommand.length()) {
-                    print(s_clearCharacter);
-                    m_inputCommand.erase(m_inputCommand.length() - 1);
-                    m_position = m_inputCommand.length();
-                } else if (m_position) {
-                    m_inputCommand.erase(--m_position, 1);
-                    print(s_moveCursorBackward);
-
-                    for (size_t i = m_position; i < m_inputCommand.length(); i++)
-                        print(std::string(1, m_inputCommand.at(i)).c_str());
-
-                    print(std::string(1, ' ').c_str());
-                    print(s_clearCharacter); // clear unused char at the end
-
-                    for (size_t i = m_position; i < m_inputCommand.length(); i++)
-                        print(s_moveCursorBackward);
-                }
+            if (!m_history.searchQuery.empty()) {
+                // The current match also contains the shorter query
+                m_history.searchQuery.erase(m_history.searchQuery.length() - 1);
+                echoCursorMove(1, 0);
+                if (m_history.searchFailed) {
+                    m_history.searchFailed = !searchHistory(m_history.searchAge);
+                    echoSearch();
+                } else
+                    echoSearchMatch();
             }
-            break;
-        case Tab:
-            printBasedOnInput(AutoCompletionType::Inline);
-            printInputCommand();
-            m_position = m_inputCommand.length();
-            break;
-        case Esc:
-            m_ctrlState = CtrlState::Esc;
-            return;
-        case LeftBracket:
-            if (m_ctrlState == CtrlState::Esc)
-                m_ctrlState = CtrlState::LeftBracket;
-            return;
+            return true;
+        case Bell: // cancel the search and keep the input
+        case EndOfText:
+            m_history.searchActive = false;
+            if (character == Bell) {
+                echoInputCommand();
+                return true;
+            }
+            return false;
         default:
-            if (m_ctrlState == CtrlState::LeftBracket) {
-                m_ctrlCharacter += character;
-                for (size_t index = 0; index < s_ctrlCharacters.size(); ++index) {
-                    if (m_ctrlCharacter.compare(0, m_ctrlCharacter.length(), s_ctrlCharacters[index], 0, m_ctrlCharacter.length()) == 0) {
-                        if (m_ctrlCharacter.length() == s_ctrlCharacters[index].length()) {
-                            switch (index) {
-                            case CharacterUp:
-                                if (m_commandHistoryIndex != m_commandHistory.begin()) {
-                                    m_inputCommand = *--m_commandHistoryIndex;
-                                    printInputCommand();
-                                    m_position = m_inputCommand.length();
-                                }
-                                break;
-                            case CharacterDown:
-                                if (m_commandHistoryIndex != m_commandHistory.end()) {
-                                    ++m_commandHistoryIndex;
-                                    if (m_commandHistoryIndex != m_commandHistory.end()) {
-                                        m_inputCommand = *m_commandHistoryIndex;
-                                    } else {
-                                        m_inputCommand.clear();
-                                    }
-                                    printInputCommand();
-                                    m_position = m_inputCommand.length();
-                                }
-                                break;
-                            case CharacterRight:
-                                if (m_position != m_inputCommand.length()) {
-                                    print(s_moveCursorForward);
-                                    m_position++;
-                                }
-                                break;
-                            case CharacterLeft:
-                                if (m_position) {
-                                    print(s_moveCursorBackward);
-                                    m_position--;
-                                }
-                                break;
-                            case CharacterHome:
-                                while (m_position) {
-                                    print(s_moveCursorBackward);
-                                    m_position--;
-                                }
-                                break;
-                            case CharacterDelete:
-                                if (m_position != m_inputCommand.length()) {
-                                    m_inputCommand.erase(m_position, 1);
-
-                                    print(std::string(1, ' ').c_str());
-                                    print(s_clearCharacter); // clear deleted char
-
-                                    for (size_t i = m_position; i < m_inputCommand.length(); i++)
-                                        print(std::string(1, m_inputCommand.at(i)).c_str());
-
-                                    print(std::string(1, ' ').c_str());
-                                    print(s_clearCharacter); // clear unused char at the end
-
-                                    for (size_t i = m_position; i < m_inputCommand.length(); i++)
-                                        print(s_moveCursorBackward);
-                                }
-                                break;
-                            case CharacterEnd:
-                                while (m_position != m_inputCommand.length()) {
-                                    print(s_moveCursorForward);
-                                    m_position++;
-                                }
-                                break;
-                            case CharacterCtrlRight:
-                                while (m_position != m_inputCommand.length() && m_inputCommand.at(m_position) == ' ') { // skip spaces until we find the first char
-                                    print(s_moveCursorForward);
-                                    m_position++;
-                                }
-                                while (m_position != m_inputCommand.length() && m_inputCommand.at(m_position) != ' ') { // skip chars until we find the first space
-                                    print(s_moveCursorForward);
-                                    m_position++;
-                                }
-                                break;
-                            case CharacterCtrlLeft:
-                                if (m_position && m_position == m_inputCommand.length()) { // step inside the m_command range
-                                    print(s_moveCursorBackward);
-                                    m_position--;
-                                }
-                                if (m_position && m_position != m_inputCommand.length() && m_inputCommand.at(m_position) != ' ') { // skip the first char
-                                    print(s_moveCursorBackward);
-                                    m_position--;
-                                }
-                                while (m_position && m_position != m_inputCommand.length() && m_inputCommand.at(m_position) == ' ') { // skip spaces until we find the first char
-                                    print(s_moveCursorBackward);
-                                    m_position--;
-                                }
-                                while (m_position && m_position != m_inputCommand.length() && m_inputCommand.at(m_position) != ' ') { // skip chars until we find the first space
-                                    print(s_moveCursorBackward);
-                                    m_position--;
-                                }
-                                if (m_position && m_position != m_inputCommand.length() && m_inputCommand.at(m_position) == ' ') { // step forward if we hit a space in order to highlight a char
-                                    print(s_moveCursorForward);
-                                    m_position++;
-                                }
-                                break;
-                            }
-                        } else
-                            return; // check the next ctrl character
-                    }
-                }
-                m_ctrlCharacter.clear();
-            } else {
-                if (m_position == m_inputCommand.length()) {
-                    print(std::string(1, character).c_str());
-                    m_inputCommand += character;
-                    m_position = m_inputCommand.length();
-                } else {
-                    print(std::string(1, character).c_str());
-                    m_inputCommand.insert(m_position++, 1, character);
+            if (static_cast<unsigned char>(character) >= ' ' && character != Del) {
+                if (!m_history.searchQuery.push_back(character))
+                    return true;
 
-                    for (size_t i = m_position; i < m_inputCommand.length(); i++)
-                        print(std::string(1, m_inputCommand.at(i)).c_str());
-                    for (size_t i = m_position; i < m_inputCommand.length(); i++)
-                        print(s_moveCursorBackward);
+                // Only search older entries if the current match does not contain the query
+                if (m_history.searchFailed)
+                    echoSearch();
+                else if (searchHistory(m_history.searchAge)) {
+                    echo(character);
+                    echoSearchMatch();
+                } else {
+                    m_history.searchFailed = true;
+                    echoSearch();
                 }
+                return true;
+            }
+
+            // Any other character ends the search with the match as input
+            m_history.searchActive = false;
+            if (!m_history.searchQuery.empty() && !m_history.searchFailed) {
+                m_inputCommand.assign(m_history.entries.at(m_history.searchAge));
+                m_history.age = m_history.searchAge + 1;
+            }
+            m_position = m_inputCommand.length();
+            echoInputCommand();
+            return false;
+        }
+    }
+
+    /// @brief Searches the history for an entry containing the query
+    /// @param age The age of the first entry to search
+    /// @return True if a match was found in which case its age is stored
+    bool searchHistory(size_t age)
+    {
+        for (; age < m_history.entries.size(); age++) {
+            if (m_history.entries.at(age).find(m_history.searchQuery) != std::string_view::npos) {
+                m_history.searchAge = age;
+                return true;
             }
-            break;
         }
 
-        m_ctrlState = CtrlState::None;
+        return false;
     }
 
-private:
-    enum Character {
-        EndOfText = 3,
-        Backspace = 8,
-        Tab = 9,
-        Esc = 27,
-        Up = 65,
-        Down = 66,
-        Right = 67,
-        Left = 68,
-        LeftBracket = 91,
-        Del = 127,
-    };
+    std::string_view searchMatch() const
+    {
+        if (m_history.searchQuery.empty() || m_history.searchAge >= m_history.entries.size())
+            return {};
 
-    enum CtrlCharacter {
-        CharacterUp = 0,
-        CharacterDown,
-        CharacterRight,
-        CharacterLeft,
-        CharacterHome,
-        CharacterDelete,
-        CharacterEnd,
-        CharacterCtrlRight,
-        CharacterCtrlLeft
-    };
+        return m_history.entries.at(m_history.searchAge);
+    }
 
-    enum class CtrlState {
-        None,
-        Esc,
-        LeftBracket
-    };
+    void echoSearch()
+    {
+        if (!deferEcho())
+            printSearch();
+    }
 
-    void runCommand()
+    void printSearch()
+    {
+        print(s_clearLine);
+        print(m_history.searchFailed ? s_failedSearchPrompt : s_searchPrompt);
+        print(m_history.searchQuery.c_str());
+        printSearchMatch();
+    }
+
+    void echoSearchMatch()
     {
-        for (const auto& command : m_commands) {
-            auto argItr = m_commandArgs.begin();
+        if (!deferEcho())
+            printSearchMatch();
+    }
 
-            if (!m_inputCommand.compare(0, command.name.size(), command.name)) {
-                auto args = m_inputCommand.substr(command.name.size());
-                char* token = std::strtok(args.data(), s_commandDelimiter);
-                while (token) {
-                    *argItr++ = token;
-                    token = std::strtok(nullptr, s_commandDelimiter);
-                    if (argItr == m_commandArgs.end())
-                        break;
-                }
+    /// @brief Prints the part of the search line after the query and moves the cursor back after the query
+    void printSearchMatch()
+    {
+        std::string_view match = searchMatch();
+        print(s_searchMatchSeparator);
+        write(match.data(), match.size());
+        print(s_eraseToEndOfLine);
+        printCursorMove(std::strlen(s_searchMatchSeparator) + match.size(), 0);
+    }
 
-                size_t argsSize = std::distance(m_commandArgs.begin(), argItr);
-                if (argsSize >= command.requiredArguments) {
-                    command.function(std::span { m_commandArgs.begin(), argItr });
-                    print(m_prompt.c_str());
-                    return;
-                }
-            }
-        }
+    /// @brief Moves the cursor to a position in the input
+    void moveCursor(size_t position)
+    {
+        echoCursorMove(m_position, position);
+        m_position = position;
+    }
 
-        printBasedOnInput(AutoCompletionType::NewLine);
-        print(m_prompt.c_str());
+    size_t nextWordPosition() const
+    {
+        size_t position = m_position;
+        while (position != m_inputCommand.length() && m_inputCommand.at(position) == ' ') // skip spaces until we find the first char
+            position++;
+        while (position != m_inputCommand.length() && m_inputCommand.at(position) != ' ') // skip chars until we find the first space
+            position++;
+
+        return position;
+    }
+
+    size_t previousWordPosition() const
+    {
+        size_t position = m_position;
+        while (position && m_inputCommand.at(position - 1) == ' ') // skip spaces until we find the last char of a word
+            position--;
+        while (position && m_inputCommand.at(position - 1) != ' ') // skip chars until we find the first char of the word
+            position--;
+
+        return position;
+    }
+
+    /// @brief Prints the input from a position and moves the cursor back to the current position
+    /// @param from The position in the input where the cursor is
+    /// @param erase True if the rest of the line should be erased (when the input got shorter)
+    void echoTail(size_t from, bool erase)
+    {
+        if (deferEcho(from, from, erase))
+            return;
+
+        write(m_inputCommand.data() + from, m_inputCommand.length() - from);
+        if (erase)
+            print(s_eraseToEndOfLine);
+        printCursorMove(m_inputCommand.length(), m_position);
+    }
+
+    void echoCursorMove(size_t from, size_t to)
+    {
+        if (!deferEcho(from, m_inputCommand.length(), false))
+            printCursorMove(from, to);
+    }
+
+    /// @brief Moves the cursor using a single escape sequence like "\033[12D"
+    void printCursorMove(size_t from, size_t to)
+    {
+        if (from == to)
+            return;
+
+        size_t count = from > to ? from - to : to - from;
+        std::array<char, 24> text { '\033', '[' };
+        char* end = text.data() + 2;
+        if (count > 1)
+            end = std::to_chars(end, text.data() + text.size() - 1, count).ptr;
+        *end++ = from > to ? 'D' : 'C';
+        write(text.data(), end - text.data());
     }
 
     void printInputCommand()
@@ -323,122 +3196,341 @@ private:
 
     void printNameAndDescription(const std::string_view name, const std::string_view desc, size_t allignmentSize)
     {
-        print(name.data());
+        printName(name, allignmentSize);
+        write(desc.data(), desc.size());
+        print("\r\n");
+    }
 
-        for (size_t start = 0; start < ((allignmentSize + 2) - name.size()); start++)
-            print(" ");
+    void printUsage(const Command& command)
+    {
+        if (command.usage.empty())
+            return;
 
-        print(desc.data());
+        print(s_usage);
+        write(command.name.data(), command.name.size());
+        print(" ");
+        write(command.usage.data(), command.usage.size());
         print("\r\n");
     }
 
-    enum class AutoCompletionType {
-        Inline,
-        NewLine,
-    };
+    void printName(const std::string_view name, size_t allignmentSize)
+    {
+        write(name.data(), name.size());
+
+        for (size_t start = 0; start < ((allignmentSize + 2) - name.size()); start++)
+            print(" ");
+    }
 
-    void printBasedOnInput(AutoCompletionType completionType)
+    /// @brief Prints the commands matching the input (or all commands if none matched)
+    /// @param input The input to be matched
+    void printMatchingCommands(std::string_view input)
     {
-        auto compareWithInputCommand = [this](const Command& command) {
-            return !m_inputCommand.empty() && !std::memcmp(command.name.data(), m_inputCommand.data(), std::min(m_inputCommand.size(), command.name.size()));
-        };
+        std::span<const Command> commands = input.empty() ? CommandSpan {} : findCommands(input, m_commands);
+        if (commands.empty()) {
+            // The input might contain arguments so fall back to the command matching the first words
+            const Command* command = input.empty() ? nullptr : findCommand(input);
+            if (!command)
+                return printCandidates(m_commands, 0, m_allCommandsSizeAlignment);
+
+            commands = { command, 1 };
+        }
 
-        const bool inlineCompletion = completionType == AutoCompletionType::Inline;
-        size_t inputCommandCounter { 0 };
         size_t alignmentSize { 0 };
-        std::string_view autoCompleteView;
+        for (const auto& command : commands)
+            alignmentSize = std::max(alignmentSize, command.name.size());
 
-        for (const auto& command : m_commands) {
-            if (compareWithInputCommand(command)) {
-                autoCompleteView = command.name;
-                alignmentSize = std::max(alignmentSize, command.name.size());
-                inputCommandCounter++;
+        for (const auto& command : commands)
+            printNameAndDescription(command.name, command.description, alignmentSize);
+    }
+
+    /// @brief Completes the input to the longest common prefix of the matching command names like bash
+    /// @param list True if the candidates should be listed if the input could not be completed (on a double Tab)
+    void completeInput(bool list)
+    {
+        CommandSpan commands = findCommands(m_inputCommand, m_commands);
+        if (commands.empty()) {
+            // The input might contain arguments so complete them or print the command matching the first words
+            if (const Command* command = findCommand(m_inputCommand)) {
+                if (command->completion)
+                    return completeArgument(*command, list);
+
+                print("\r\n");
+                printNameAndDescription(command->name, command->description, command->name.size());
+                printInput();
             }
+            return;
         }
 
-        // Only one command with the given input - print auto completion for this one
-        if (inlineCompletion && inputCommandCounter == 1) {
-            auto completeCommand = std::string { autoCompleteView } + std::string { s_commandDelimiter };
-            if (completeCommand.size() > m_inputCommand.size()) {
-                m_inputCommand = completeCommand;
-                return;
-            }
+        // The commands are sorted so the prefix shared by the first and the last command is shared by all of them
+        std::string_view first = commands.front().name;
+        std::string_view last = commands.back().name;
+        size_t prefixSize = static_cast<size_t>(std::mismatch(first.begin(), first.end(), last.begin(), last.end()).first - first.begin());
+        bool completed = commands.size() == 1
+            ? first.size() + 1 > m_inputCommand.size() && completeInputCommand(first)
+            : prefixSize > m_inputCommand.size() && prefixSize <= m_inputCommand.capacity() && m_inputCommand.assign(first.substr(0, prefixSize));
+
+        if (completed) {
+            echoInputCommand();
+            m_position = m_inputCommand.length();
+            return;
         }
 
-        // Go to next line to make it look like we're still inline
-        if (inlineCompletion)
-            print("\r\n");
+        if (!list) {
+            m_tabPending = true;
+            return;
+        }
 
-        // No commands matching the input was found so print all instead
-        if (inputCommandCounter == 0)
-            return printAllCommands();
-
-        // More than one command was found so print all descriptions matching instead
-        std::string_view lastCommandView;
-        size_t uniqueCounter { 0 };
-
-        for (const auto& command : m_commands) {
-            if (compareWithInputCommand(command)) {
-                printNameAndDescription(command.name, command.description, alignmentSize);
-                std::string_view commandNameSub = command.name.substr(0, command.name.find_first_of(s_commandDelimiter));
-                if (commandNameSub != lastCommandView) {
-                    lastCommandView = commandNameSub;
-                    uniqueCounter++;
-                }
-            }
+        // The alignment of all commands is known when all of them are listed
+        size_t alignmentSize { m_allCommandsSizeAlignment };
+        if (!m_inputCommand.empty()) {
+            alignmentSize = 0;
+            forEachCandidate(commands, m_inputCommand.size(), [&alignmentSize](std::string_view name, const Command*) { alignmentSize = std::max(alignmentSize, name.size()); });
         }
 
-        // Auto complete if a single sub name was found
-        if (uniqueCounter == 1 && (lastCommandView.size() > m_inputCommand.size()))
-            m_inputCommand = std::string { lastCommandView } + std::string { s_commandDelimiter };
+        print("\r\n");
+        printCandidates(commands, m_inputCommand.size(), alignmentSize);
+        printInput();
     }
 
-
-    void printAllCommands()
+    /// @brief Completes the last argument of the input using the candidates added by the completion function of the command
+    /// @param command The command matching the first words of the input
+    /// @param list True if the candidates should be listed if the argument could not be completed (on a double Tab)
+    void completeArgument(const Command& command, bool list)
     {
-        std::list<std::string_view> groupedCommands;
-        for (const auto& command : m_commands) {
-            // If command name contains a delimiter it means that we can group those
-            auto position = command.name.find_first_of(s_commandDelimiter);
-            if (position != std::string::npos) {
-                auto subView = command.name.substr(0, position);
-                if (std::find(groupedCommands.begin(), groupedCommands.end(), subView) != groupedCommands.end())
-                    continue;
+        // The arguments before the last one are tokenized in a copy of the input
+        std::string_view input = m_inputCommand;
+        size_t start = input.find_last_of(s_commandDelimiter) + 1;
+        FixedString<TConfig.maxCommandLength> arguments { input.substr(0, start) };
+        std::array<std::string_view, TConfig.maxRequiredArgs> args;
+        size_t argsSize = tokenize({ arguments.data() + command.name.size(), start - command.name.size() }, args);
+
+        std::array<char, TConfig.completionBufferSize> buffer;
+        Completions completions { input.substr(start), buffer, TConfig.maxCompletions };
+        command.completion({ args.begin(), std::min(argsSize, args.size()) }, completions);
+
+        // A single candidate is completed with a delimiter like a command name
+        std::string_view common = completions.common();
+        bool complete = !completions.truncated() && completions.size() == 1;
+        if (!completions.truncated() && common.size() + start + complete <= m_inputCommand.capacity() && (complete || common.size() > completions.prefix().size())) {
+            m_inputCommand.erase(start, m_inputCommand.length() - start);
+            for (char character : common)
+                m_inputCommand.push_back(character);
+            if (complete)
+                m_inputCommand.push_back(s_commandDelimiter[0]);
 
-                groupedCommands.push_back(subView);
+            return printInput();
+        }
+
+        if (!list) {
+            m_tabPending = completions.size() > 0;
+            return;
+        }
 
-                // Group commands like: i2c  I2c commands
-                auto firstCommandView = command.name.substr(0, position);
-                std::string firstCommand = std::string { firstCommandView.begin(), firstCommandView.end() } + " commands";
-                firstCommand[0] = toupper(firstCommand[0]);
+        print("\r\n");
+        completions.forEach([this](std::string_view candidate) {
+            write(candidate.data(), candidate.size());
+            print("\r\n");
+        });
+        if (completions.truncated())
+            print("...\r\n");
+        printInput();
+    }
 
-                // We have to do the string conversion as the subspan_view is not terminated
-                printNameAndDescription(std::string { subView }, firstCommand, m_allCommandsSizeAlignment);
-            } else {
-                printNameAndDescription(command.name, command.description, m_allCommandsSizeAlignment);
+    /// @brief Calls a function for each command or group of commands sharing the words up to the next delimiter
+    /// @param commands The (sorted) commands starting with the same prefix
+    /// @param prefixSize The size of the prefix
+    /// @param function The function called with the name and the command (or nullptr for a group)
+    ///
+    /// The commands of a group are skipped by a binary search so the time is proportional to the number of names.
+    template <typename TFunction>
+    static constexpr void forEachCandidate(CommandSpan commands, size_t prefixSize, TFunction&& function)
+    {
+        for (auto command = commands.begin(); command != commands.end();) {
+            size_t position = command->name.find_first_of(s_commandDelimiter, prefixSize);
+            if (position == std::string_view::npos) {
+                function(command->name, &*command);
+                command++;
+                continue;
             }
+
+            function(command->name.substr(0, position), nullptr);
+            command = findCommands(command->name.substr(0, position + 1), { command, commands.end() }).end();
         }
     }
 
-    static constexpr const char* s_clearLine = "\033[2K\033[100D";
+    /// @brief Prints the commands where the commands sharing the next word are grouped like: i2c  I2c commands
+    void printCandidates(CommandSpan commands, size_t prefixSize, size_t alignmentSize)
+    {
+        forEachCandidate(commands, prefixSize, [this, alignmentSize](std::string_view name, const Command* command) {
+            if (command)
+                return printNameAndDescription(name, command->description, alignmentSize);
+
+            printName(name, alignmentSize);
+            printCharacter(static_cast<char>(std::toupper(name.front())));
+            write(name.data() + 1, name.size() - 1);
+            print(" commands\r\n");
+        });
+    }
+
+    /// @brief Prints the prompt and the input on a new line with the cursor at the end
+    void printInput()
+    {
+        echoInputCommand();
+        m_position = m_inputCommand.length();
+    }
+
+    /// @brief Replaces the input with the given name followed by a delimiter
+    /// @return False if the name did not fit in which case the input is unchanged
+    bool completeInputCommand(std::string_view name)
+    {
+        if (name.size() + 1 > m_inputCommand.capacity())
+            return false;
+
+        m_inputCommand.assign(name);
+        m_inputCommand.push_back(s_commandDelimiter[0]);
+        return true;
+    }
+
+    static constexpr const char* s_clearLine = "\r\033[K";
     static constexpr const char* s_clearScreen = "\033[2J\x1B[H";
-    static constexpr const char* s_clearCharacter = "\033[1D \033[1D";
-    static constexpr const char* s_moveCursorForward = "\033[1C";
-    static constexpr const char* s_moveCursorBackward = "\033[1D";
+    static constexpr const char* s_eraseToEndOfLine = "\033[K";
+    static constexpr const char* s_searchPrompt = "(reverse-i-search)'";
+    static constexpr const char* s_failedSearchPrompt = "(failed reverse-i-search)'";
+    static constexpr const char* s_searchMatchSeparator = "': ";
     static constexpr const char* s_commandDelimiter = " ";
-    static constexpr std::array<std::string_view, 9> s_ctrlCharacters { { { "A" }, { "B" }, { "C" }, { "D" }, { "1~" }, { "3~" }, { "4~" }, { "1;5C" }, { "1;5D" } } };
+    static constexpr size_t s_inputBatchSize { 64 };
+    static constexpr std::string_view s_historyHeader { "YH\x01" }; // Magic and version of the stored history
+    static constexpr size_t s_historyStorageMaxSize { s_historyHeader.size() + 2 * (TConfig.commandHistoryBytes + TConfig.commandHistorySize) };
+    static constexpr const char* s_tooManyArguments = "Too many arguments, ignoring the last ones\r\n";
+    static constexpr const char* s_invalidArgument = "Invalid argument: ";
+    static constexpr const char* s_commandNotFound = "Command not found: ";
+    static constexpr std::string_view s_repeatBuiltin { "repeat" };
+    static constexpr std::string_view s_timeBuiltin { "time" };
+    static constexpr const char* s_repeatUsage = "Usage: repeat <count> <command>\r\n";
+    static constexpr const char* s_timeUsage = "Usage: time <command>\r\n";
+    static constexpr const char* s_noClock = "No clock set for timing\r\n";
+    static constexpr std::string_view s_failedIteration { "Failed in iteration {}\n" };
+    static constexpr std::string_view s_time { "Time: {} us\n" };
+    static constexpr std::string_view s_timeIterations { "Time: {} us for {} iterations ({} us each)\n" };
+    static constexpr std::string_view s_statsBuiltin { "stats" };
+    static constexpr std::string_view s_statsReset { "reset" };
+    static constexpr const char* s_statsUsage = "Usage: stats [reset]\r\n";
+    static constexpr std::string_view s_statsCalls { "{} calls, {} errors" };
+    static constexpr std::string_view s_statsLatency { ", <{} us: {}" };
+    static constexpr std::string_view s_statsLatencyAbove { ", >={} us: {}" };
+    static constexpr std::string_view s_truncatedMarker { "...\r\n" };
+    static constexpr const char* s_lineTooLong = "Line too long\r\n";
+    static constexpr char s_scriptComment { '#' };
+    static constexpr const char* s_usage = "Usage: ";
 
-    CtrlState m_ctrlState { CtrlState::None };
+    /// @brief The state of the command history and the history search
+    struct HistoryState {
+        CommandHistory<TConfig.commandHistorySize, TConfig.commandHistoryBytes> entries;
+        size_t age { 0 }; // The age of the next entry to recall (0 when not recalling)
+        FixedString<TConfig.maxCommandLength> searchQuery;
+        size_t searchAge { 0 }; // The age of the history entry matching the search query
+        bool searchActive { false };
+        bool searchFailed { false };
+        HistoryStorage storage;
+        size_t storageSize { 0 };
+        bool storageLoaded { false };
+    };
+
+    /// @brief The buffer collecting the output of an input event
+    struct OutputBuffer {
+        std::array<char, TConfig.outputBufferSize + 1> data; // Not initialized as it is written before it is read
+        size_t size { 0 };
+    };
+
+    static constexpr bool s_outputBuffer { TConfig.outputBufferSize > 0 };
+    static constexpr bool s_history { TConfig.commandHistorySize > 0 };
+    static constexpr bool s_statistics { TConfig.statisticsSize > 0 };
+    static constexpr bool s_rpc { TConfig.rpcFrameSize > 0 };
+    static constexpr bool s_txQueue { TConfig.txQueueSize > 0 };
+    static constexpr bool s_async { TConfig.asyncCommands };
+    static_assert(s_txQueue == std::is_same_v<std::invoke_result_t<TSink&, const char*, size_t>, size_t>,
+        "A sink returning the number of bytes accepted needs a txQueueSize (and only such a sink can use the queue)");
+    static constexpr bool s_timing { TConfig.chaining || s_statistics }; // The clock is used by the time built-in and the statistics
+
+    [[no_unique_address]] Feature<TConfig.keySequences, KeyDecoder> m_keyDecoder;
+    [[no_unique_address]] InputQueue<TConfig.inputQueueSize> m_inputQueue;
     CommandSpan m_commands;
+    TSink m_sink;
     std::array<std::string_view, TConfig.maxRequiredArgs> m_commandArgs;
-    std::function<void(const char*)> m_printFunction;
-    std::list<std::string> m_commandHistory;
-    std::list<std::string>::const_iterator m_commandHistoryIndex;
-    std::string m_inputCommand;
-    std::string m_prompt { "Yash$ " };
-    std::string m_ctrlCharacter;
+    [[no_unique_address]] Feature<s_outputBuffer, OutputBuffer> m_output;
+    [[no_unique_address]] Feature<s_history, HistoryState> m_history;
+    FixedString<TConfig.maxCommandLength> m_inputCommand;
+    FixedString<TConfig.maxPromptLength> m_prompt { "Yash$ " };
     size_t m_position { 0 };
-    size_t m_commandHistorySize { 0 };
+    bool m_burst { false };
+
+    /// @brief The changes of the input deferred while handling a burst of characters (see setCharacters())
+    struct Render {
+        bool pending { false };
+        bool prompt { false }; // The prompt and the input are rendered (e.g. when a history entry replaced the input)
+        bool erase { false }; // The rest of the line is erased as the input might have gotten shorter
+        size_t cursor { 0 }; // The position of the cursor on the terminal
+        size_t from { SIZE_MAX }; // The first position of the input which changed
+    };
+
+    Render m_render;
+    bool m_tabPending { false };
+
+    /// @brief The state of running the chained commands of an input line
+    struct Job {
+        std::span<char> chain; // The commands following the running command
+        ChainOperator chainOperator { ChainOperator::Sequence }; // The operator between the running command and the following commands
+        const Command* command { nullptr }; // The last command run (used as a hint when looking up the next command)
+        bool commandIsPrefix { false }; // The name of the last command run is the prefix of the next command
+        size_t commands { 0 }; // The number of commands run
+        bool script { false }; // Set while a script is running
+    };
+
+    Job m_job;
+    int m_status { Success };
+    [[no_unique_address]] Feature<TConfig.chaining, Repetition> m_repetition;
+    [[no_unique_address]] Feature<s_timing, ClockFunction> m_clock {};
+
+    /// @brief The invocation statistics of the commands
+    struct StatisticsState {
+        std::array<CommandStatistics, TConfig.statisticsSize> commands; // Indexed like the command table
+        uint64_t start { 0 }; // The time the running asynchronous command (or its iteration) was started
+    };
+
+    [[no_unique_address]] Feature<s_statistics, StatisticsState> m_statistics;
+
+    /// @brief The state of the RPC mode
+    struct RpcState {
+        RpcDecoder<TConfig.maxCommandLength> decoder;
+        std::array<char, TConfig.rpcFrameSize + RpcFrame::s_overhead> frame; // The response frame being filled with output
+        size_t size { 0 }; // The size of the output in the response frame
+        size_t magicSize { 0 }; // The number of characters of the magic sequence received
+        uint8_t sequence { 0 }; // The sequence number of the request being answered
+        bool active { false };
+    };
+
+    [[no_unique_address]] Feature<s_rpc, RpcState> m_rpc;
+
+    /// @brief The queue of the output not accepted by a non-blocking sink
+    struct TxQueue {
+        std::array<char, TConfig.txQueueSize> data;
+        size_t head { 0 };
+        size_t size { 0 };
+        size_t dropped { 0 }; // The number of bytes dropped because the queue was full
+        bool truncated { false }; // Set when the marker has been queued until the queue has been emptied
+    };
+
+    [[no_unique_address]] Feature<s_txQueue, TxQueue> m_tx;
+
+    /// @brief The state of the running asynchronous command
+    struct AsyncState {
+        AsyncCommandFunction function { nullptr }; // The running command (nullptr if no command is running)
+        size_t argsSize { 0 };
+        CommandState state;
+    };
+
+    [[no_unique_address]] Feature<s_async, AsyncState> m_async;
+    [[no_unique_address]] Feature<s_async || s_txQueue, FixedString<TConfig.typeAheadSize>> m_typeAhead; // The input received while a command is running or the input is paused
 
     const size_t m_allCommandsSizeAlignment;
 };
@@ -0,0 +1,78 @@
+// Copyright 2022 - Bang & Olufsen a/s
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include "Yash.h"
+#include <cstdio>
+#include <string>
+
+namespace Yash {
+
+/// @brief A command history storage using a file (e.g. on a Linux host)
+class HistoryFile {
+public:
+    /// @brief Constructor
+    /// @param path The path of the file to be used (which is created if needed)
+    explicit HistoryFile(std::string path)
+        : m_path(std::move(path))
+        , m_file(std::fopen(m_path.c_str(), "a+b"))
+    {
+    }
+
+    ~HistoryFile()
+    {
+        if (m_file)
+            std::fclose(m_file);
+    }
+
+    HistoryFile(const HistoryFile&) = delete;
+    HistoryFile& operator=(const HistoryFile&) = delete;
+
+    /// @brief Gets the storage to be used by Yash::setHistoryStorage()
+    /// @return The storage using this file
+    HistoryStorage storage()
+    {
+        return {
+            [](void* file, size_t offset, char* data, size_t size) { return static_cast<HistoryFile*>(file)->read(offset, data, size); },
+            [](void* file, const char* data, size_t size) { static_cast<HistoryFile*>(file)->append(data, size); },
+            [](void* file) { static_cast<HistoryFile*>(file)->clear(); },
+            this,
+        };
+    }
+
+private:
+    size_t read(size_t offset, char* data, size_t size)
+    {
+        if (!m_file || std::fseek(m_file, static_cast<long>(offset), SEEK_SET))
+            return 0;
+
+        return std::fread(data, 1, size, m_file);
+    }
+
+    void append(const char* data, size_t size)
+    {
+        if (!m_file)
+            return;
+
+        // The file is opened for appending so all writes go to the end
+        std::fwrite(data, 1, size, m_file);
+        std::fflush(m_file);
+    }
+
+    void clear()
+    {
+        if (m_file)
+            std::fclose(m_file);
+
+        // Truncate the file before opening it for appending again
+        if (std::FILE* file = std::fopen(m_path.c_str(), "wb"))
+            std::fclose(file);
+        m_file = std::fopen(m_path.c_str(), "a+b");
+    }
+
+    std::string m_path;
+    std::FILE* m_file;
+};
+
+} // namespace Yash
@@ -0,0 +1,38 @@
+// Copyright 2022 - Bang & Olufsen a/s
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include "Yash.h"
+#include <cstdio>
+#include <optional>
+#include <string>
+
+namespace Yash {
+
+/// @brief Runs a script file of newline separated commands (e.g. in a factory test on a Linux host)
+/// @param yash The shell running the commands
+/// @param path The path of the script file
+/// @param stopOnFailure True if the script should stop at the first failed line
+/// @return The number of commands run and the failed lines, or std::nullopt if the file could not be read
+template <typename TYash>
+std::optional<ScriptResult> runScriptFile(TYash& yash, const char* path, bool stopOnFailure = false)
+{
+    std::FILE* file = std::fopen(path, "rb");
+    if (!file)
+        return std::nullopt;
+
+    std::string script;
+    std::array<char, 4096> chunk;
+    while (size_t size = std::fread(chunk.data(), 1, chunk.size(), file))
+        script.append(chunk.data(), size);
+
+    bool failed = std::ferror(file);
+    std::fclose(file);
+    if (failed)
+        return std::nullopt;
+
+    return yash.runScriptInPlace(script, stopOnFailure);
+}
+
+} // namespace Yash
@@ -0,0 +1,280 @@
+// Copyright 2022 - Bang & Olufsen a/s
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include "YashSessionPool.h"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace Yash {
+
+/// @brief An output sink writing to a file descriptor (e.g. a socket, a pty or a serial port)
+///
+/// It returns the number of bytes accepted by a non-blocking file descriptor, so the shell needs a txQueueSize
+/// in its Config for the output which could not be written yet.
+struct FileDescriptorSink {
+    int fd { -1 };
+
+    size_t operator()(const char* data, size_t size) const
+    {
+        size_t accepted { 0 };
+        while (accepted < size) {
+            // Sockets are written without raising SIGPIPE when the peer has gone
+            ssize_t written = ::send(fd, data + accepted, size - accepted, MSG_NOSIGNAL);
+            if (written < 0 && errno == ENOTSOCK)
+                written = ::write(fd, data + accepted, size - accepted);
+
+            if (written < 0) {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    break;
+                return size; // the output is dropped as the session is closed when reading fails
+            }
+
+            accepted += static_cast<size_t>(written);
+        }
+
+        return accepted;
+    }
+};
+
+/// @brief A shell server on Linux serving a number of sessions from one epoll loop
+/// @tparam TConfig The configuration of each session
+/// @tparam TSessions The maximum number of open sessions
+///
+/// Sessions are opened for TCP connections (e.g. from telnet or netcat) and for file descriptors
+/// added by attach() (e.g. a pty or a serial port). The file descriptors are non-blocking so a client
+/// which does not read its output cannot stall the other sessions. The output it does not take is kept
+/// in the transmit queue of its session, which is written when the client can take more, and its input
+/// is not read while the queue is above the txHighWater of the Config.
+template <Config TConfig, size_t TSessions>
+class Server {
+    static_assert(TConfig.txQueueSize > 0, "The server needs a txQueueSize for the output not taken by a client yet");
+    static_assert(TConfig.txOverflow != TxOverflow::Block, "The server cannot block on a client which does not read its output");
+
+public:
+    using Pool = SessionPool<TConfig, TSessions, FileDescriptorSink>;
+    using Session = typename Pool::Session;
+
+    /// @brief Constructor
+    /// @param commandTable The command table shared by the sessions
+    explicit Server(const CommandTable& commandTable)
+        : m_pool(commandTable)
+        , m_epoll(::epoll_create1(EPOLL_CLOEXEC))
+    {
+    }
+
+    ~Server()
+    {
+        m_pool.forEach([](Session& session) { ::close(session.sink().fd); });
+        if (m_listener >= 0)
+            ::close(m_listener);
+        if (m_epoll >= 0)
+            ::close(m_epoll);
+    }
+
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    /// @brief Starts listening for TCP connections
+    /// @param port The port to listen on (0 selects a free port which can be read by port())
+    /// @param address The IPv4 address to listen on
+    /// @return True if the server is listening
+    bool listen(uint16_t port, const char* address = "127.0.0.1")
+    {
+        int listener = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listener < 0)
+            return false;
+
+        int reuse { 1 };
+        ::setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+        sockaddr_in socketAddress {};
+        socketAddress.sin_family = AF_INET;
+        socketAddress.sin_port = htons(port);
+        if (::inet_pton(AF_INET, address, &socketAddress.sin_addr) != 1
+            || ::bind(listener, reinterpret_cast<sockaddr*>(&socketAddress), sizeof(socketAddress))
+            || ::listen(listener, SOMAXCONN)
+            || !add(listener, nullptr)) {
+            ::close(listener);
+            return false;
+        }
+
+        m_listener = listener;
+        return true;
+    }
+
+    /// @brief Gets the port the server is listening on
+    /// @return The port or 0 if the server is not listening
+    uint16_t port() const
+    {
+        sockaddr_in socketAddress {};
+        socklen_t size { sizeof(socketAddress) };
+        if (m_listener < 0 || ::getsockname(m_listener, reinterpret_cast<sockaddr*>(&socketAddress), &size))
+            return 0;
+
+        return ntohs(socketAddress.sin_port);
+    }
+
+    /// @brief Opens a session for a file descriptor (e.g. a pty or a serial port)
+    /// @param fd The file descriptor used for reading and writing, which is made non-blocking and is closed with the session
+    /// @return A pointer to the session or nullptr if all sessions are open
+    Session* attach(int fd)
+    {
+        int flags = ::fcntl(fd, F_GETFL);
+        if (flags < 0 || ::fcntl(fd, F_SETFL, flags | O_NONBLOCK))
+            return nullptr;
+
+        return open(fd);
+    }
+
+    /// @brief Waits for and handles new connections and received input
+    /// @param timeoutMs The maximum time to wait in milliseconds (-1 waits until something happens)
+    /// @return False if waiting failed
+    ///
+    /// While a session is running an asynchronous command, which is stepped once per poll, the server waits
+    /// at most s_stepIntervalMs so the command makes progress without the loop spinning.
+    bool poll(int timeoutMs)
+    {
+        if (m_busy && (timeoutMs < 0 || timeoutMs > s_stepIntervalMs))
+            timeoutMs = s_stepIntervalMs;
+
+        std::array<epoll_event, 16> events;
+        int count = ::epoll_wait(m_epoll, events.data(), static_cast<int>(events.size()), timeoutMs);
+        if (count < 0)
+            return errno == EINTR;
+
+        for (int index = 0; index < count; index++) {
+            auto* connection = static_cast<Connection*>(events[index].data.ptr);
+            if (!connection) {
+                accept();
+                continue;
+            }
+
+            if (events[index].events & EPOLLOUT)
+                m_pool.txReady(*connection->session);
+            if (events[index].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                receive(*connection);
+        }
+
+        // A session waiting for its output to be taken is woken by EPOLLOUT instead of the step interval
+        m_pool.poll();
+        m_busy = false;
+        for (Connection& connection : m_connections) {
+            if (connection.session) {
+                update(connection);
+                m_busy = m_busy || (connection.session->busy() && !connection.session->txPaused());
+            }
+        }
+
+        return true;
+    }
+
+    /// @brief Gets the session handling input (e.g. for commands printing to the session running them)
+    /// @return A pointer to the session or nullptr if no input is being handled
+    Session* current() const { return m_pool.current(); }
+
+    Pool& pool() { return m_pool; }
+
+private:
+    /// @brief An open session with the events it is waiting for
+    struct Connection {
+        Session* session { nullptr };
+        uint32_t events { EPOLLIN };
+    };
+
+    bool add(int fd, void* pointer)
+    {
+        epoll_event event {};
+        event.events = EPOLLIN;
+        event.data.ptr = pointer;
+        return !::epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &event);
+    }
+
+    Session* open(int fd)
+    {
+        auto connection = std::find_if(m_connections.begin(), m_connections.end(), [](const Connection& connection) { return !connection.session; });
+        Session* session = connection != m_connections.end() ? m_pool.open({ fd }) : nullptr;
+        if (!session)
+            return nullptr;
+
+        if (!add(fd, &*connection)) {
+            m_pool.close(*session);
+            return nullptr;
+        }
+
+        *connection = { session };
+        session->printPrompt();
+        update(*connection);
+        return session;
+    }
+
+    /// @brief Waits for the output queued by a session to be taken, and for input unless it is paused
+    void update(Connection& connection)
+    {
+        Session& session = *connection.session;
+        uint32_t events { 0 };
+        if (!session.txPaused())
+            events |= EPOLLIN;
+        if (session.txQueued())
+            events |= EPOLLOUT;
+        if (events == connection.events)
+            return;
+
+        epoll_event event {};
+        event.events = events;
+        event.data.ptr = &connection;
+        if (!::epoll_ctl(m_epoll, EPOLL_CTL_MOD, session.sink().fd, &event))
+            connection.events = events;
+    }
+
+    void accept()
+    {
+        int fd = ::accept4(m_listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;
+
+        // Send the echo right away instead of waiting for more output
+        int noDelay { 1 };
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+        if (!open(fd))
+            ::close(fd); // all sessions are open
+    }
+
+    void receive(Connection& connection)
+    {
+        Session& session = *connection.session;
+        std::array<char, 256> data;
+        ssize_t size = ::read(session.sink().fd, data.data(), data.size());
+        if (size > 0)
+            return m_pool.feed(session, { data.data(), static_cast<size_t>(size) });
+        if (size < 0 && (errno == EINTR || errno == EAGAIN))
+            return;
+
+        // The connection was closed
+        int fd = session.sink().fd;
+        ::epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, nullptr);
+        ::close(fd);
+        m_pool.close(session);
+        connection = {};
+    }
+
+    static constexpr int s_stepIntervalMs { 1 };
+
+    Pool m_pool;
+    std::array<Connection, TSessions> m_connections;
+    int m_epoll;
+    int m_listener { -1 };
+    bool m_busy { false };
+};
+
+} // namespace Yash
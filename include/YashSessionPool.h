@@ -0,0 +1,127 @@
+// Copyright 2022 - Bang & Olufsen a/s
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include "Yash.h"
+#include <optional>
+
+namespace Yash {
+
+/// @brief A pool of shell sessions sharing one command table (e.g. for a UART, a USB port and telnet at the same time)
+/// @tparam TConfig The configuration of each session
+/// @tparam TSessions The maximum number of open sessions
+/// @tparam TSink The output sink of each session (which typically identifies the connection)
+///
+/// The command table is shared and immutable so each session only stores its own editing state.
+template <Config TConfig, size_t TSessions, typename TSink = FunctionSink>
+class SessionPool {
+public:
+    using Session = Yash<TConfig, TSink>;
+
+    /// @brief Constructor
+    /// @param commandTable The command table shared by the sessions
+    constexpr explicit SessionPool(const CommandTable& commandTable)
+        : m_commandTable(commandTable)
+    {
+    }
+
+    SessionPool(const SessionPool&) = delete;
+    SessionPool& operator=(const SessionPool&) = delete;
+
+    /// @brief Opens a session
+    /// @param sink The output sink of the session
+    /// @return A pointer to the session or nullptr if all sessions are open
+    Session* open(TSink sink = {})
+    {
+        for (auto& session : m_sessions) {
+            if (!session)
+                return &session.emplace(m_commandTable, std::move(sink));
+        }
+
+        return nullptr;
+    }
+
+    /// @brief Closes a session
+    /// @param session The session to be closed
+    void close(Session& session)
+    {
+        for (auto& openSession : m_sessions) {
+            if (openSession && &*openSession == &session)
+                openSession.reset();
+        }
+    }
+
+    /// @brief Sets a number of received characters on a session
+    /// @param session The session receiving the characters
+    /// @param characters The characters to be set
+    ///
+    /// The session is the current session while the characters are handled.
+    void feed(Session& session, std::string_view characters)
+    {
+        m_current = &session;
+        session.feed(characters);
+        m_current = nullptr;
+    }
+
+    /// @brief Writes the queued output of a session to its non-blocking sink which can accept more
+    /// @param session The session to be written
+    ///
+    /// The session is the current session while the input typed while its input was paused is handled.
+    void txReady(Session& session)
+        requires(TConfig.txQueueSize > 0)
+    {
+        m_current = &session;
+        session.txReady();
+        m_current = nullptr;
+    }
+
+    /// @brief Polls the open sessions (e.g. to step their asynchronous commands)
+    /// @return True if a session is running an asynchronous command
+    ///
+    /// Each session is the current session while it is polled.
+    bool poll()
+    {
+        bool busy { false };
+        for (auto& session : m_sessions) {
+            if (session) {
+                m_current = &*session;
+                session->poll();
+                busy = busy || session->busy();
+            }
+        }
+
+        m_current = nullptr;
+        return busy;
+    }
+
+    /// @brief Gets the session handling input (e.g. for commands printing to the session running them)
+    /// @return A pointer to the session or nullptr if no input is being handled
+    Session* current() const { return m_current; }
+
+    /// @brief Calls a function for each open session
+    /// @param function The function to be called with a reference to the session
+    template <typename TFunction>
+    void forEach(TFunction&& function)
+    {
+        for (auto& session : m_sessions) {
+            if (session)
+                function(*session);
+        }
+    }
+
+    /// @brief Gets the number of open sessions
+    size_t size() const
+    {
+        return std::count_if(m_sessions.begin(), m_sessions.end(), [](const auto& session) { return session.has_value(); });
+    }
+
+    static constexpr size_t capacity() { return TSessions; }
+
+private:
+    CommandTable m_commandTable;
+    std::array<std::optional<Session>, TSessions> m_sessions;
+    Session* m_current { nullptr };
+};
+
+} // namespace Yash
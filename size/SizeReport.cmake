@@ -0,0 +1,50 @@
+# Writes the .text, .data and .bss sizes of each reference configuration to the report and compares
+# them with a baseline report (if any).
+#
+# Usage: cmake -DSIZE_TOOL=<size> -DOBJECTS=<objects> -DNAMES=<names> -DREPORT=<file> [-DBASELINE=<file>] -P SizeReport.cmake
+
+cmake_minimum_required(VERSION 3.18)
+
+set(REPORT_TEXT "config text data bss\n")
+foreach(OBJECT NAME IN ZIP_LISTS OBJECTS NAMES)
+    execute_process(COMMAND ${SIZE_TOOL} -B ${OBJECT} OUTPUT_VARIABLE OUTPUT RESULT_VARIABLE RESULT)
+    if (RESULT)
+        message(FATAL_ERROR "Failed to get the size of ${OBJECT}")
+    endif()
+
+    # The second line holds the text, data, bss, dec and hex sizes and the file name
+    string(REGEX MATCH "\n[ \t]*([0-9]+)[ \t]+([0-9]+)[ \t]+([0-9]+)" MATCH "${OUTPUT}")
+    set(SIZES "${CMAKE_MATCH_1} ${CMAKE_MATCH_2} ${CMAKE_MATCH_3}")
+    string(APPEND REPORT_TEXT "${NAME} ${SIZES}\n")
+    set(SIZES_${NAME} ${CMAKE_MATCH_1} ${CMAKE_MATCH_2} ${CMAKE_MATCH_3})
+endforeach()
+
+file(WRITE ${REPORT} "${REPORT_TEXT}")
+message("${REPORT_TEXT}")
+
+if (NOT BASELINE)
+    return()
+endif()
+
+file(STRINGS ${BASELINE} BASELINE_LINES)
+set(SECTIONS text data bss)
+set(GROWN FALSE)
+foreach(LINE ${BASELINE_LINES})
+    string(REPLACE " " ";" BASELINE_SIZES "${LINE}")
+    list(POP_FRONT BASELINE_SIZES NAME)
+    if (NOT DEFINED SIZES_${NAME})
+        continue() # the header or a configuration which has been removed
+    endif()
+
+    foreach(SECTION BASELINE_SIZE SIZE IN ZIP_LISTS SECTIONS BASELINE_SIZES SIZES_${NAME})
+        if (SIZE GREATER BASELINE_SIZE)
+            math(EXPR GROWTH "${SIZE} - ${BASELINE_SIZE}")
+            message(SEND_ERROR "The .${SECTION} of ${NAME} has grown by ${GROWTH} bytes to ${SIZE} bytes")
+            set(GROWN TRUE)
+        endif()
+    endforeach()
+endforeach()
+
+if (GROWN)
+    message(FATAL_ERROR "The footprint has grown compared to ${BASELINE}")
+endif()
@@ -0,0 +1,46 @@
+// Copyright 2022 - Bang & Olufsen a/s
+// SPDX-License-Identifier: MIT
+
+#include <Yash.h>
+
+// Called for the output of the shell (defined by the target)
+extern "C" void yashWrite(const char* data, size_t size);
+
+namespace {
+
+/// @brief The reference configurations of the size report
+constexpr std::array<Yash::Config, 4> s_configs { {
+    // Everything enabled
+    { .maxRequiredArgs = 3, .commandHistorySize = 10 },
+    // No command history
+    { .maxRequiredArgs = 3, .commandHistorySize = 0 },
+    // No command history, cursor editing or escape sequences
+    { .maxRequiredArgs = 3, .commandHistorySize = 0, .editing = false, .keySequences = false },
+    // Only running commands (without chaining them or stepping asynchronous commands)
+    { .maxRequiredArgs = 3, .commandHistorySize = 0, .maxCommandLength = 32, .editing = false, .keySequences = false, .completion = false, .help = false, .chaining = false, .asyncCommands = false },
+} };
+
+/// @brief An output sink calling the output of the target directly (so std::function is not needed)
+struct WriteSink {
+    void operator()(const char* data, size_t size) const { yashWrite(data, size); }
+};
+
+void info(Yash::CommandArgs /* unused */) { }
+void i2cRead(Yash::CommandArgs /* unused */) { }
+void i2cWrite(Yash::CommandArgs /* unused */) { }
+
+constexpr auto s_commands = std::to_array<Yash::Command>({
+    { "i2c read", "I2C read <addr> <reg> <bytes>", &i2cRead, 3 },
+    { "i2c write", "I2C write <addr> <reg> <value>", &i2cWrite, 3 },
+    { "info", "System info", &info, 0 },
+});
+
+// A global shell so its RAM is reported in .bss
+Yash::Yash<s_configs[SIZE_REPORT_CONFIG], WriteSink> s_yash(s_commands);
+
+} // namespace
+
+extern "C" void yashCharacter(char character)
+{
+    s_yash.setCharacter(character);
+}
@@ -1,9 +1,20 @@
 // Copyright 2021 - Bang & Olufsen a/s
 #include "turtle/catch.hpp"
 #include <catch.hpp>
+#include <deque>
+#include <filesystem>
+#include <optional>
+#include <random>
+#include <sys/socket.h>
+#include <thread>
+#include <vector>
 
 #define private public
 #include "Yash.h"
+#include "YashHistoryFile.h"
+#include "YashScriptFile.h"
+#include "YashServer.h"
+#include "YashSessionPool.h"
 
 #define SetupHistoryPreconditions()             \
     MOCK_EXPECT(print);                         \
@@ -18,15 +29,38 @@ using namespace std::string_literals;
 
 namespace {
 
+size_t s_allocations { 0 };
+
 MOCK_FUNCTION(print, 1, void(const char*));
 MOCK_FUNCTION(i2c, 1, void(Yash::CommandArgs));
 MOCK_FUNCTION(info, 1, void(Yash::CommandArgs));
+MOCK_FUNCTION(dump, 2, bool(Yash::CommandArgs, Yash::CommandState&));
+MOCK_FUNCTION(check, 1, int(Yash::CommandArgs));
 
-constexpr const char* s_clearCharacter = "\033[1D \033[1D";
-constexpr const char* s_moveCursorForward = "\033[1C";
-constexpr const char* s_moveCursorBackward = "\033[1D";
+constexpr const char* s_eraseToEndOfLine = "\033[K";
+constexpr const char* s_moveCursorForward = "\033[C";
+constexpr const char* s_moveCursorBackward = "\033[D";
 } // namespace
 
+void* operator new(size_t size)
+{
+    s_allocations++;
+    if (void* pointer = std::malloc(size))
+        return pointer;
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+    std::free(pointer);
+}
+
 
 TEST_CASE("Yash test")
 {
@@ -104,25 +138,24 @@ TEST_CASE("Yash test")
 
     SECTION("Test setCharacter function with 'i' + TAB input and two similar commands")
     {
+        // The first TAB can not complete the input so nothing is printed
+        MOCK_EXPECT(print).once().with("i");
+        yash.setCharacter('i');
+        yash.setCharacter(yash.Tab);
+
         mock::sequence seq;
-        MOCK_EXPECT(print).once().in(seq).with("i");
         MOCK_EXPECT(print).once().in(seq).with(mock::any);
 
-        // Print i2c read command + alignment
-        MOCK_EXPECT(print).once().in(seq).with(commands.at(0).name);
+        // Print the i2c commands as a group + alignment
+        MOCK_EXPECT(print).once().in(seq).with("i2c");
         MOCK_EXPECT(print).exactly(3).in(seq).with(" ");
-        MOCK_EXPECT(print).once().in(seq).with(commands.at(0).description);
-        MOCK_EXPECT(print).once().in(seq).with("\r\n");
-
-        // Print i2c write command + alignment
-        MOCK_EXPECT(print).once().in(seq).with(commands.at(1).name);
-        MOCK_EXPECT(print).exactly(2).in(seq).with(" ");
-        MOCK_EXPECT(print).once().in(seq).with(commands.at(1).description);
-        MOCK_EXPECT(print).once().in(seq).with("\r\n");
+        MOCK_EXPECT(print).once().in(seq).with("I");
+        MOCK_EXPECT(print).once().in(seq).with("2c");
+        MOCK_EXPECT(print).once().in(seq).with(" commands\r\n");
 
         // Print info command + alignment
         MOCK_EXPECT(print).once().in(seq).with(commands.at(2).name);
-        MOCK_EXPECT(print).exactly(7).in(seq).with(" ");
+        MOCK_EXPECT(print).exactly(2).in(seq).with(" ");
         MOCK_EXPECT(print).once().in(seq).with(commands.at(2).description);
         MOCK_EXPECT(print).once().in(seq).with("\r\n");
 
@@ -130,7 +163,7 @@ TEST_CASE("Yash test")
         MOCK_EXPECT(print).once().in(seq).with(prompt.c_str());
         MOCK_EXPECT(print).once().in(seq).with("i");
 
-        yash.setCharacter('i');
+        // A double TAB lists the candidates
         yash.setCharacter(yash.Tab);
     }
 
@@ -144,7 +177,7 @@ TEST_CASE("Yash test")
         yash.setCharacter('2'); // pos 1
         yash.setCharacter('c'); // pos 2
 
-        MOCK_EXPECT(print).exactly(3).with(s_moveCursorBackward).in(seq);
+        MOCK_EXPECT(print).once().with("\033[3D").in(seq);
         yash.setCharacter(yash.Esc);
         yash.setCharacter(yash.LeftBracket);
         yash.setCharacter('1');
@@ -152,11 +185,9 @@ TEST_CASE("Yash test")
         yash.setCharacter('5');
         yash.setCharacter('D');
 
-        MOCK_EXPECT(print).once().with('C').in(seq);
-        MOCK_EXPECT(print).once().with("i").in(seq);
-        MOCK_EXPECT(print).once().with("2").in(seq);
-        MOCK_EXPECT(print).once().with("c").in(seq);
-        MOCK_EXPECT(print).exactly(3).with(s_moveCursorBackward).in(seq);
+        // The tail is printed at once before moving the cursor back
+        MOCK_EXPECT(print).once().with("Ci2c").in(seq);
+        MOCK_EXPECT(print).once().with("\033[3D").in(seq);
         yash.setCharacter(yash.Right);
     }
 
@@ -235,6 +266,15 @@ TEST_CASE("Yash test")
             yash.setCharacter(character);
     }
 
+    SECTION("Test setCharacter function with 'infox' input does not run 'info'")
+    {
+        MOCK_EXPECT(info).never();
+        MOCK_EXPECT(print);
+
+        for (char& character : "infox\n"s)
+            yash.setCharacter(character);
+    }
+
     SECTION("Test setCharacter function with too few arguments 'i2c read 1 2' input")
     {
         std::string testCommand = "i2c read 1 2\n";
@@ -344,9 +384,11 @@ TEST_CASE("Yash test")
     SECTION("Test setCharacter function with ESC/LeftBracket input")
     {
         yash.setCharacter(yash.Esc);
-        CHECK(yash.m_ctrlState == yash.CtrlState::Esc);
+        CHECK(yash.m_keyDecoder.pending());
         yash.setCharacter(yash.LeftBracket);
-        CHECK(yash.m_ctrlState == yash.CtrlState::LeftBracket);
+        CHECK(yash.m_keyDecoder.pending());
+        yash.setCharacter(yash.Up);
+        CHECK_FALSE(yash.m_keyDecoder.pending());
     }
 
     SECTION("Test setCharacter function with 'i21c' and backspace character input")
@@ -455,11 +497,8 @@ TEST_CASE("Yash test")
         {
             // Generate delete press to remove char '2'
             mock::sequence seq;
-            MOCK_EXPECT(print).once().with(" ").in(seq);
-            MOCK_EXPECT(print).once().with(s_clearCharacter).in(seq);
             MOCK_EXPECT(print).once().with("c").in(seq);
-            MOCK_EXPECT(print).once().with(" ").in(seq);
-            MOCK_EXPECT(print).once().with(s_clearCharacter).in(seq);
+            MOCK_EXPECT(print).once().with(s_eraseToEndOfLine).in(seq);
             MOCK_EXPECT(print).exactly(1).with(s_moveCursorBackward).in(seq);
             yash.setCharacter(yash.Esc);
             yash.setCharacter(yash.LeftBracket);
@@ -498,7 +537,7 @@ TEST_CASE("Yash test")
         {
             // Generate home key press to set cursor position to the beginning @pos 0
             mock::sequence seq;
-            MOCK_EXPECT(print).exactly(7).with(s_moveCursorBackward).in(seq);
+            MOCK_EXPECT(print).once().with("\033[7D").in(seq);
             yash.setCharacter(yash.Esc);
             yash.setCharacter(yash.LeftBracket);
             yash.setCharacter('1');
@@ -510,7 +549,7 @@ TEST_CASE("Yash test")
         {
             // Generate end key press to set cursor position to the end again @pos 7
             mock::sequence seq;
-            MOCK_EXPECT(print).exactly(7).with(s_moveCursorForward).in(seq);
+            MOCK_EXPECT(print).once().with("\033[7C").in(seq);
             yash.setCharacter(yash.Esc);
             yash.setCharacter(yash.LeftBracket);
             yash.setCharacter('4');
@@ -546,8 +585,7 @@ TEST_CASE("Yash test")
         {
             // Generate ctrl+left key press to set cursor position to the 'i' @pos 4
             mock::sequence seq;
-            MOCK_EXPECT(print).exactly(4).with(s_moveCursorBackward).in(seq);
-            MOCK_EXPECT(print).once().with(s_moveCursorForward).in(seq);
+            MOCK_EXPECT(print).once().with("\033[3D").in(seq);
             yash.setCharacter(yash.Esc);
             yash.setCharacter(yash.LeftBracket);
             yash.setCharacter('1');
@@ -561,7 +599,7 @@ TEST_CASE("Yash test")
         {
             // Generate ctrl+left key press to set cursor position to the 'i' @pos 0
             mock::sequence seq;
-            MOCK_EXPECT(print).exactly(4).with(s_moveCursorBackward).in(seq);
+            MOCK_EXPECT(print).once().with("\033[4D").in(seq);
             yash.setCharacter(yash.Esc);
             yash.setCharacter(yash.LeftBracket);
             yash.setCharacter('1');
@@ -575,7 +613,7 @@ TEST_CASE("Yash test")
         {
             // Generate ctrl+right key press to set cursor position to the space @pos 3
             mock::sequence seq;
-            MOCK_EXPECT(print).exactly(3).with(s_moveCursorForward).in(seq);
+            MOCK_EXPECT(print).once().with("\033[3C").in(seq);
             yash.setCharacter(yash.Esc);
             yash.setCharacter(yash.LeftBracket);
             yash.setCharacter('1');
@@ -589,7 +627,7 @@ TEST_CASE("Yash test")
         {
             // Generate ctrl+right key press to set cursor position to the end again @pos 7
             mock::sequence seq;
-            MOCK_EXPECT(print).exactly(4).with(s_moveCursorForward).in(seq);
+            MOCK_EXPECT(print).once().with("\033[4C").in(seq);
             yash.setCharacter(yash.Esc);
             yash.setCharacter(yash.LeftBracket);
             yash.setCharacter('1');
@@ -714,3 +752,2607 @@ TEST_CASE("Yash test")
     mock::verify();
     mock::reset();
 }
+
+TEST_CASE("Yash buffered output test")
+{
+    static constexpr Yash::Config config { .maxRequiredArgs = 3, .commandHistorySize = 10 };
+    static constexpr Yash::Config bufferedConfig { .maxRequiredArgs = 3, .commandHistorySize = 10, .outputBufferSize = 16 };
+    static constexpr auto commands = std::to_array<Yash::Command>({
+        { "i2c read", "I2C read <addr> <reg> <bytes>", &i2c, 3 },
+        { "i2c write", "I2C write <addr> <reg> <bytes>", &i2c, 3 },
+        { "info", "System info", &info, 0 },
+    });
+
+    std::string output;
+    std::string bufferedOutput;
+    std::vector<size_t> writeSizes;
+    size_t flushCount { 0 };
+
+    Yash::Yash<config> yash(commands);
+    Yash::Yash<bufferedConfig> bufferedYash(commands);
+
+    yash.setWrite([&](const char* data, size_t size) { output.append(data, size); });
+    bufferedYash.setWrite([&](const char* data, size_t size) {
+        bufferedOutput.append(data, size);
+        writeSizes.push_back(size);
+    });
+    bufferedYash.setFlush([&]() { flushCount++; });
+
+    SECTION("Test one write per input event")
+    {
+        bufferedYash.setCharacter('i');
+        bufferedYash.setCharacter('2');
+        CHECK(writeSizes == std::vector<size_t> { 1, 1 });
+        CHECK(flushCount == 2);
+    }
+
+    SECTION("Test overflow writes the buffer in chunks")
+    {
+        for (char character : "i\t\t"s) {
+            yash.setCharacter(character);
+            bufferedYash.setCharacter(character);
+        }
+
+        CHECK(output == bufferedOutput);
+        CHECK(std::all_of(writeSizes.begin(), writeSizes.end(), [](size_t size) { return size <= bufferedConfig.outputBufferSize; }));
+        CHECK(writeSizes.size() == 1 + (output.size() - 1 + bufferedConfig.outputBufferSize - 1) / bufferedConfig.outputBufferSize);
+    }
+
+    SECTION("Test output is flushed before running a command")
+    {
+        MOCK_EXPECT(info).once().calls([&](Yash::CommandArgs) {
+            CHECK(bufferedOutput == "info\r\n");
+        });
+
+        for (char character : "info\n"s)
+            bufferedYash.setCharacter(character);
+    }
+
+    SECTION("Test print function with buffered output")
+    {
+        std::string printOutput;
+        bufferedYash.setWrite(nullptr);
+        bufferedYash.setPrint([&](const char* text) { printOutput += text; });
+
+        for (char character : "i\t\t"s) {
+            yash.setCharacter(character);
+            bufferedYash.setCharacter(character);
+        }
+
+        CHECK(output == printOutput);
+    }
+
+    mock::verify();
+    mock::reset();
+}
+
+TEST_CASE("Yash bulk input test")
+{
+    static constexpr Yash::Config config { .maxRequiredArgs = 3, .commandHistorySize = 10 };
+    static constexpr auto commands = std::to_array<Yash::Command>({
+        { "i2c read", "I2C read <addr> <reg> <bytes>", &i2c, 3 },
+        { "i2c write", "I2C write <addr> <reg> <bytes>", &i2c, 3 },
+        { "info", "System info", &info, 0 },
+    });
+
+    std::string output;
+    size_t writeCount { 0 };
+
+    Yash::Yash<config> yash(commands);
+    yash.setPrompt("$ ");
+    yash.setWrite([&](const char* data, size_t size) {
+        output.append(data, size);
+        writeCount++;
+    });
+
+    SECTION("Test feed with a complete line renders the line once")
+    {
+        std::vector<std::string> result { "1", "2", "3" };
+        MOCK_EXPECT(i2c).once().calls([&result](Yash::CommandArgs args) {
+            CHECK(std::equal(args.begin(), args.end(), result.begin(), result.end()));
+        });
+
+        yash.feed("i2c read 1 2 3\n");
+        CHECK(output == "i2c read 1 2 3\r\n$ ");
+    }
+
+    SECTION("Test feed runs every complete line in order")
+    {
+        mock::sequence seq;
+        MOCK_EXPECT(info).once().in(seq);
+        MOCK_EXPECT(i2c).once().in(seq);
+        MOCK_EXPECT(info).once().in(seq);
+
+        yash.feed("info\ni2c write 1 2 3\rinfo\nin");
+        CHECK(yash.m_inputCommand == "in");
+        CHECK(output.ends_with("\r\n$ in"));
+    }
+
+    SECTION("Test feed with a single change only echoes the change")
+    {
+        yash.feed("info");
+        output.clear();
+
+        yash.feed("\033[D");
+        CHECK(output == "\033[D");
+    }
+
+    SECTION("Test feed with cursor movement places the cursor")
+    {
+        yash.feed("i2\033[Dx");
+        CHECK(yash.m_inputCommand == "ix2");
+        CHECK(output == "ix2\033[D");
+    }
+
+    SECTION("Test feed only writes the input from the first change")
+    {
+        yash.feed("info");
+        output.clear();
+
+        yash.feed("\033[D\033[Dx");
+        CHECK(yash.m_inputCommand == "inxfo");
+        CHECK(output == "\033[2Dxfo\033[2D");
+
+        output.clear();
+        yash.feed("\033[4~\x7f\x7f\x7f");
+        CHECK(yash.m_inputCommand == "in");
+        CHECK(output == "\033[D\033[K");
+    }
+
+    SECTION("Test setCharacters uses fewer writes than setCharacter")
+    {
+        std::string input = "i2c read 1 2 3";
+        yash.setCharacters(input);
+        size_t burstWriteCount = writeCount;
+
+        writeCount = 0;
+        yash.setCharacter(yash.EndOfText);
+        for (char character : input)
+            yash.setCharacter(character);
+
+        CHECK(burstWriteCount < writeCount);
+    }
+
+    mock::verify();
+    mock::reset();
+}
+
+namespace {
+
+/// @brief Checks if a command table can be constructed at compile time (which fails if the commands are not sorted)
+template <const auto& TCommands>
+concept IsConstantCommandTable = requires { typename std::integral_constant<size_t, Yash::CommandTable(TCommands).nameAlignment()>; };
+
+} // namespace
+
+TEST_CASE("Yash sorted commands test")
+{
+    static constexpr Yash::Config config { .maxRequiredArgs = 3, .commandHistorySize = 10 };
+    static constexpr auto commands = Yash::sortCommands(std::to_array<Yash::Command>({
+        { "system reset", "Reset the system", &info, 0 },
+        { "info", "System info", &info, 0 },
+        { "i2c write", "I2C write <addr> <reg> <bytes>", &i2c, 3 },
+        { "i2c", "I2C status", &info, 0 },
+        { "i2c read", "I2C read <addr> <reg> <bytes>", &i2c, 3 },
+        { "system", "System status", &info, 0 },
+    }));
+
+    static_assert(Yash::isSorted(commands));
+    static_assert(commands.front().name == "i2c");
+    static_assert(commands.back().name == "system reset");
+
+    // Commands which are not sorted would not be found by the binary search so they fail the compilation
+    static constexpr auto unsortedCommands = std::to_array<Yash::Command>({
+        { "zeta", "Zeta", &info, 0 },
+        { "info", "System info", &info, 0 },
+    });
+    static_assert(!Yash::isSorted(unsortedCommands));
+    static_assert(IsConstantCommandTable<commands>);
+    static_assert(!IsConstantCommandTable<unsortedCommands>);
+
+    std::string output;
+    Yash::Yash<config> yash(commands);
+    yash.setPrompt("$ ");
+    yash.setWrite([&](const char* data, size_t size) { output.append(data, size); });
+
+    SECTION("Test findCommands returns the range of commands with a prefix")
+    {
+        CHECK(yash.findCommands("i2c", commands).size() == 3);
+        CHECK(yash.findCommands("i2c ", commands).size() == 2);
+        CHECK(yash.findCommands("s", commands).size() == 2);
+        CHECK(yash.findCommands("x", commands).empty());
+    }
+
+    SECTION("Test findCommand matches whole words only")
+    {
+        CHECK(yash.findCommand("i2c") == &commands[0]);
+        CHECK(yash.findCommand("i2c read 1 2 3") == &commands[1]);
+        CHECK(yash.findCommand("i2c rea") == &commands[0]);
+        CHECK(yash.findCommand("i2cx") == nullptr);
+        CHECK(yash.findCommand("systemx") == nullptr);
+    }
+
+    SECTION("Test findCommand only uses a hint which is the longest matching command")
+    {
+        CHECK(yash.findCommand("i2c read 1", &commands[1]) == &commands[1]);
+        CHECK(yash.findCommand("i2c write 1", &commands[0]) == &commands[2]);
+        CHECK(yash.findCommand("i2c 1", &commands[0]) == &commands[0]);
+        CHECK(yash.findCommand("info", &commands[0]) == &commands[3]);
+        CHECK(yash.findCommand("system reset", &commands[5]) == &commands[5]);
+        CHECK(yash.findCommand("x", &commands[5]) == nullptr);
+        CHECK(yash.findCommand("info 1", &commands[3], false) == &commands[3]);
+    }
+
+    SECTION("Test the previous command of a script is only used when it is the longest matching command")
+    {
+        MOCK_EXPECT(info).exactly(5); // i2c, info and system
+        MOCK_EXPECT(i2c).once();
+
+        CHECK(yash.runScript("info\ninfo\ni2c\ni2c read 1 2 3\nsystem\nsystem\n").commands == 6);
+    }
+
+    SECTION("Test the longest matching command is run")
+    {
+        MOCK_EXPECT(info).never();
+        MOCK_EXPECT(i2c).once();
+
+        yash.feed("i2c write 1 2 3\n");
+    }
+
+    SECTION("Test grouped commands are printed once")
+    {
+        yash.feed("\t\t");
+        CHECK(output == "\r\ni2c     I2C status\r\ni2c     I2c commands\r\ninfo    System info\r\nsystem  System status\r\nsystem  System commands\r\n\r\033[K$ ");
+    }
+
+    SECTION("Test TAB after the arguments prints the command")
+    {
+        yash.feed("i2c read 1 2");
+        output.clear();
+
+        yash.setCharacter(yash.Tab);
+        CHECK(output == "\r\ni2c read  I2C read <addr> <reg> <bytes>\r\n\r\033[K$ i2c read 1 2");
+    }
+
+    mock::verify();
+    mock::reset();
+}
+
+TEST_CASE("Yash tokenize test")
+{
+    static constexpr Yash::Config config { .maxRequiredArgs = 3, .commandHistorySize = 10 };
+    static constexpr auto commands = std::to_array<Yash::Command>({
+        { "i2c read", "I2C read <addr> <reg> <bytes>", &i2c, 3 },
+        { "i2c write", "I2C write <addr> <reg> <bytes>", &i2c, 3 },
+        { "info", "System info", &info, 0 },
+    });
+
+    using Shell = Yash::Yash<config>;
+    std::array<std::string_view, 3> tokens;
+
+    auto tokenize = [&tokens](std::string& input) {
+        return Shell::tokenize({ input.data(), input.size() }, tokens);
+    };
+
+    SECTION("Test tokens separated by multiple delimiters")
+    {
+        std::string input = "  1  2 ";
+        CHECK(tokenize(input) == 2);
+        CHECK(tokens[0] == "1");
+        CHECK(tokens[1] == "2");
+        CHECK(tokens[0].data()[tokens[0].size()] == '\0');
+        CHECK(tokens[1].data()[tokens[1].size()] == '\0');
+    }
+
+    SECTION("Test tokens with quotes and escapes")
+    {
+        std::string input = "\"1 2\" a\\ b \\\"c\\\" \"\"";
+        CHECK(tokenize(input) == 3 + 1);
+        CHECK(tokens[0] == "1 2");
+        CHECK(tokens[1] == "a b");
+        CHECK(tokens[2] == "\"c\"");
+    }
+
+    SECTION("Test an empty quoted token")
+    {
+        std::string input = "\"\" x";
+        CHECK(tokenize(input) == 2);
+        CHECK(tokens[0].empty());
+        CHECK(tokens[1] == "x");
+    }
+
+    SECTION("Test more tokens than the span size")
+    {
+        std::string input = "1 2 3 4 5";
+        CHECK(tokenize(input) == 5);
+        CHECK(tokens[2] == "3");
+    }
+
+    SECTION("Test arguments are tokenized without changing the history")
+    {
+        Shell yash(commands);
+        std::vector<std::string> result { "1 2", "3", "4" };
+
+        MOCK_EXPECT(print);
+        MOCK_EXPECT(i2c).exactly(2).calls([&result](Yash::CommandArgs args) {
+            CHECK(std::equal(args.begin(), args.end(), result.begin(), result.end()));
+            CHECK(args[0].data()[args[0].size()] == '\0');
+        });
+
+        yash.setPrint(print);
+        yash.feed("i2c read \"1 2\" 3 4\n");
+        CHECK(yash.m_history.entries.at(0) == "i2c read \"1 2\" 3 4");
+
+        yash.feed("\033[A\n");
+    }
+
+    SECTION("Test too many arguments are reported")
+    {
+        Shell yash(commands);
+        std::string output;
+
+        MOCK_EXPECT(i2c).once();
+        yash.setWrite([&](const char* data, size_t size) { output.append(data, size); });
+        yash.feed("i2c read 1 2 3 4\n");
+        CHECK(output.find(Shell::s_tooManyArguments) != std::string::npos);
+    }
+
+    mock::verify();
+    mock::reset();
+}
+
+TEST_CASE("Yash fixed line buffer test")
+{
+    static constexpr Yash::Config config { .maxRequiredArgs = 3, .commandHistorySize = 0, .maxCommandLength = 8, .maxPromptLength = 4 };
+    static constexpr auto commands = std::to_array<Yash::Command>({
+        { "i2c read", "I2C read <addr> <reg> <bytes>", [](Yash::CommandArgs) {}, 0 },
+        { "info", "System info", [](Yash::CommandArgs) {}, 0 },
+    });
+
+    Yash::Yash<config> yash(commands);
+    std::string output;
+    output.reserve(1024);
+    yash.setWrite([&output](const char* data, size_t size) { output.append(data, size); });
+
+    SECTION("Test FixedString operations")
+    {
+        Yash::FixedString<4> text { "abcdef" };
+        CHECK(text == "abcd");
+        CHECK(text.full());
+        CHECK_FALSE(text.push_back('e'));
+
+        text.erase(1, 2);
+        CHECK(text == "ad");
+        CHECK(text.insert(1, 'x'));
+        CHECK(text == "axd");
+        CHECK(std::string_view(text.c_str()) == "axd");
+        CHECK_FALSE(text.insert(4, 'y'));
+    }
+
+    SECTION("Test characters are ignored when the line is full")
+    {
+        yash.feed("info 123456");
+        CHECK(yash.m_inputCommand == "info 123");
+
+        yash.feed("\033[D\033[Dx");
+        CHECK(yash.m_inputCommand == "info 123");
+    }
+
+    SECTION("Test completion which does not fit is ignored")
+    {
+        yash.feed("i2c r\t");
+        CHECK(yash.m_inputCommand == "i2c r");
+    }
+
+    SECTION("Test prompt is truncated")
+    {
+        yash.setPrompt("prompt$ ");
+        CHECK(yash.m_prompt == "prom");
+    }
+
+    SECTION("Test no allocations when editing and running commands")
+    {
+        std::string input = "i\t\033[D\033[C\b\bi2c \t\x7f" "1 2 3\nin\t\r\x03";
+        size_t allocations = s_allocations;
+
+        for (char character : input)
+            yash.setCharacter(character);
+
+        CHECK(s_allocations == allocations);
+    }
+}
+
+TEST_CASE("Yash command history test")
+{
+    SECTION("Test the oldest entries are evicted when the bytes are used")
+    {
+        Yash::CommandHistory<3, 8> history;
+        CHECK(history.push("aaa"));
+        CHECK(history.push("bbb"));
+        CHECK(history.push("ccc"));
+
+        CHECK(history.size() == 2);
+        CHECK(history.at(0) == "ccc");
+        CHECK(history.at(1) == "bbb");
+
+        CHECK(history.push("dddddddd"));
+        CHECK(history.size() == 1);
+        CHECK(history.at(0) == "dddddddd");
+    }
+
+    SECTION("Test the oldest entries are evicted when the entries are used")
+    {
+        Yash::CommandHistory<2, 64> history;
+        history.push("a");
+        history.push("b");
+        history.push("c");
+
+        CHECK(history.size() == 2);
+        CHECK(history.at(0) == "c");
+        CHECK(history.at(1) == "b");
+    }
+
+    SECTION("Test a newer entry overlapping a wrapped entry is evicted")
+    {
+        Yash::CommandHistory<8, 100> history;
+        CHECK(history.push(std::string(64, 'a')));
+        CHECK(history.push(std::string(30, 'b')));
+        CHECK(history.push(std::string(40, 'c')));
+        CHECK(history.push(std::string(62, 'd')));
+
+        CHECK(history.size() == 1);
+        CHECK(history.at(0) == std::string(62, 'd'));
+    }
+
+    SECTION("Test random entries against a reference history")
+    {
+        Yash::CommandHistory<10, 320> history;
+        std::deque<std::string> reference;
+        std::mt19937 generator(2021);
+        std::uniform_int_distribution<size_t> sizes(1, 100);
+
+        for (size_t push = 0; push < 10000; push++) {
+            std::string text(sizes(generator), static_cast<char>('a' + push % 26));
+            CHECK(history.push(text));
+            reference.push_back(text);
+
+            REQUIRE(history.size() > 0);
+            REQUIRE(history.size() <= 10);
+            while (reference.size() > history.size())
+                reference.pop_front();
+
+            for (size_t age = 0; age < history.size(); age++)
+                REQUIRE(history.at(age) == reference[reference.size() - 1 - age]);
+        }
+    }
+
+    SECTION("Test consecutive duplicates, empty and too large entries are not added")
+    {
+        Yash::CommandHistory<4, 8> history;
+        CHECK(history.push("a"));
+        CHECK_FALSE(history.push("a"));
+        CHECK_FALSE(history.push(""));
+        CHECK_FALSE(history.push("123456789"));
+        CHECK(history.push("b"));
+        CHECK(history.push("a"));
+        CHECK(history.size() == 3);
+    }
+
+    SECTION("Test history recall without allocations")
+    {
+        static constexpr Yash::Config config { .maxRequiredArgs = 3, .commandHistorySize = 4, .commandHistoryBytes = 16 };
+        static constexpr auto commands = std::to_array<Yash::Command>({
+            { "info", "System info", [](Yash::CommandArgs) {}, 0 },
+        });
+
+        Yash::Yash<config> yash(commands);
+        std::string input = "info 1\ninfo 2\ninfo 3\n\033[A\033[A\033[A\033[B";
+        size_t allocations = s_allocations;
+
+        for (char character : input)
+            yash.setCharacter(character);
+
+        CHECK(s_allocations == allocations);
+        CHECK(yash.m_history.entries.size() == 2);
+        CHECK(yash.m_inputCommand == "info 3");
+    }
+}
+
+TEST_CASE("Yash history storage test")
+{
+    static constexpr Yash::Config config { .maxRequiredArgs = 3, .commandHistorySize = 4, .commandHistoryBytes = 32 };
+    static constexpr auto commands = std::to_array<Yash::Command>({
+        { "info", "System info", [](Yash::CommandArgs) {}, 0 },
+    });
+
+    struct MemoryStorage {
+        std::string stored;
+        size_t readCount { 0 };
+        size_t appendCount { 0 };
+        size_t clearCount { 0 };
+    } memory;
+    std::string& stored = memory.stored;
+    size_t& readCount = memory.readCount;
+    size_t& appendCount = memory.appendCount;
+    size_t& clearCount = memory.clearCount;
+
+    Yash::HistoryStorage storage {
+        [](void* context, size_t offset, char* data, size_t size) {
+            auto& memory = *static_cast<MemoryStorage*>(context);
+            memory.readCount++;
+            if (offset >= memory.stored.size())
+                return size_t { 0 };
+            return memory.stored.copy(data, size, offset);
+        },
+        [](void* context, const char* data, size_t size) {
+            auto& memory = *static_cast<MemoryStorage*>(context);
+            memory.appendCount++;
+            memory.stored.append(data, size);
+        },
+        [](void* context) {
+            auto& memory = *static_cast<MemoryStorage*>(context);
+            memory.clearCount++;
+            memory.stored.clear();
+        },
+        &memory,
+    };
+
+    Yash::Yash<config> yash(commands);
+    yash.setHistoryStorage(storage);
+
+    SECTION("Test the history is loaded when used")
+    {
+        CHECK(readCount == 0);
+        yash.feed("info 1\n");
+        CHECK(readCount == 1);
+        CHECK(stored == "YH\x01\x06info 1");
+
+        yash.feed("info 2\n");
+        CHECK(appendCount == 3);
+        CHECK(stored == "YH\x01\x06info 1\x06info 2");
+    }
+
+    SECTION("Test the history is restored")
+    {
+        yash.feed("info 1\ninfo 2\ninfo 2\n");
+
+        Yash::Yash<config> restoredYash(commands);
+        restoredYash.setHistoryStorage(storage);
+        restoredYash.feed("\033[A\033[A");
+        CHECK(restoredYash.m_inputCommand == "info 1");
+        CHECK(restoredYash.m_history.entries.size() == 2);
+    }
+
+    SECTION("Test the history is rewritten when it has grown")
+    {
+        for (char number : "0123456789ab"s)
+            yash.feed("info "s + number + "\n");
+
+        CHECK(clearCount == 2);
+        CHECK(stored.size() <= yash.s_historyStorageMaxSize);
+        CHECK(stored.starts_with("YH\x01"));
+
+        Yash::Yash<config> restoredYash(commands);
+        restoredYash.setHistoryStorage(storage);
+        restoredYash.feed("\033[A");
+        CHECK(restoredYash.m_inputCommand == "info b");
+        CHECK(restoredYash.m_history.entries.size() == 4);
+    }
+
+    SECTION("Test the stored history is older than the history entered before the storage was set")
+    {
+        stored = "YH\x01\x08info old"s;
+
+        Yash::Yash<config> restoredYash(commands);
+        restoredYash.feed("info new\n");
+        restoredYash.setHistoryStorage(storage);
+        restoredYash.feed("\033[A");
+        CHECK(restoredYash.m_inputCommand == "info new");
+        restoredYash.feed("\033[A");
+        CHECK(restoredYash.m_inputCommand == "info old");
+
+        // The storage is rewritten so the entries are stored in the same order
+        CHECK(stored == "YH\x01\x08info old\x08info new"s);
+    }
+
+    SECTION("Test an unknown version or partial entry is discarded")
+    {
+        stored = "YH\x02\x06info 1";
+        yash.feed("\033[A");
+        CHECK(yash.m_inputCommand.empty());
+        CHECK(stored == "YH\x01");
+
+        stored = "YH\x01\x06info 1\x06inf";
+        Yash::Yash<config> restoredYash(commands);
+        restoredYash.setHistoryStorage(storage);
+        restoredYash.feed("\033[A");
+        CHECK(restoredYash.m_inputCommand == "info 1");
+        CHECK(stored == "YH\x01\x06info 1");
+    }
+
+    SECTION("Test the history file")
+    {
+        std::string path = (std::filesystem::temp_directory_path() / "yash-history-test").string();
+        std::remove(path.c_str());
+
+        {
+            Yash::HistoryFile file(path);
+            yash.setHistoryStorage(file.storage());
+            yash.feed("info 1\ninfo 2\n");
+        }
+
+        Yash::HistoryFile file(path);
+        Yash::Yash<config> restoredYash(commands);
+        restoredYash.setHistoryStorage(file.storage());
+        restoredYash.feed("\033[A\033[A");
+        CHECK(restoredYash.m_inputCommand == "info 1");
+
+        std::remove(path.c_str());
+    }
+}
+
+TEST_CASE("Yash reverse search test")
+{
+    static constexpr Yash::Config config { .maxRequiredArgs = 3, .commandHistorySize = 10 };
+    static constexpr auto commands = std::to_array<Yash::Command>({
+        { "i2c read", "I2C read <addr> <reg> <bytes>", &i2c, 3 },
+        { "i2c write", "I2C write <addr> <reg> <bytes>", &i2c, 3 },
+        { "info", "System info", &info, 0 },
+    });
+
+    constexpr char reverseSearch = 18;
+    std::string output;
+
+    Yash::Yash<config> yash(commands);
+    yash.setPrompt("$ ");
+    yash.setWrite([&](const char* data, size_t size) { output.append(data, size); });
+
+    MOCK_EXPECT(info).exactly(2);
+    MOCK_EXPECT(i2c).once();
+    yash.feed("info 1\ni2c read 1 2 3\ninfo 2\n");
+    output.clear();
+
+    SECTION("Test search and run a match")
+    {
+        MOCK_EXPECT(i2c).once();
+
+        yash.setCharacter(reverseSearch);
+        CHECK(output == "\r\033[K(reverse-i-search)'': \033[K\033[3D");
+
+        yash.feed("2c");
+        CHECK(yash.m_inputCommand.empty());
+        yash.setCharacter('\n');
+    }
+
+    SECTION("Test only the changed part is printed")
+    {
+        yash.setCharacter(reverseSearch);
+        yash.feed("inf");
+        output.clear();
+
+        yash.setCharacter('o');
+        CHECK(output == "o': info 2\033[K\033[9D");
+    }
+
+    SECTION("Test repeated search finds older matches")
+    {
+        yash.setCharacter(reverseSearch);
+        yash.feed("info");
+        CHECK(yash.searchMatch() == "info 2");
+
+        yash.setCharacter(reverseSearch);
+        CHECK(yash.searchMatch() == "info 1");
+        output.clear();
+
+        yash.setCharacter(reverseSearch);
+        CHECK(yash.m_history.searchFailed);
+        CHECK(output == "\r\033[K(failed reverse-i-search)'info': info 1\033[K\033[9D");
+
+        yash.setCharacter(yash.Backspace);
+        CHECK_FALSE(yash.m_history.searchFailed);
+    }
+
+    SECTION("Test cancel search keeps the input")
+    {
+        yash.feed("in");
+        yash.setCharacter(reverseSearch);
+        yash.feed("i2c");
+        yash.setCharacter(yash.Bell);
+
+        CHECK_FALSE(yash.m_history.searchActive);
+        CHECK(yash.m_inputCommand == "in");
+    }
+
+    SECTION("Test other keys use the match as input")
+    {
+        yash.setCharacter(reverseSearch);
+        yash.feed("read");
+        yash.feed("\033[D");
+
+        CHECK_FALSE(yash.m_history.searchActive);
+        CHECK(yash.m_inputCommand == "i2c read 1 2 3");
+        CHECK(yash.m_position == yash.m_inputCommand.length() - 1);
+
+        // Up continues from the match
+        yash.feed("\033[A");
+        CHECK(yash.m_inputCommand == "info 1");
+    }
+
+    mock::verify();
+    mock::reset();
+}
+
+TEST_CASE("Yash line renderer test")
+{
+    static constexpr Yash::Config config { .maxRequiredArgs = 3, .commandHistorySize = 10 };
+    static constexpr auto commands = std::to_array<Yash::Command>({
+        { "info", "System info", &info, 0 },
+    });
+
+    std::string output;
+    Yash::Yash<config> yash(commands);
+    yash.setWrite([&](const char* data, size_t size) { output.append(data, size); });
+    yash.feed("info 1 2 3 4 5 6 7 8 9");
+    output.clear();
+
+    SECTION("Test insert at the beginning of the line")
+    {
+        yash.feed("\033[1~");
+        CHECK(output == "\033[22D");
+        output.clear();
+
+        yash.setCharacter('x');
+        CHECK(output == "xinfo 1 2 3 4 5 6 7 8 9\033[22D");
+    }
+
+    SECTION("Test backspace and delete in the middle of the line")
+    {
+        yash.feed("\033[1;5D\033[1;5D");
+        output.clear();
+
+        yash.setCharacter(yash.Backspace);
+        CHECK(output == "\033[D8 9\033[K\033[3D");
+        output.clear();
+
+        yash.feed("\033[3~");
+        CHECK(output == " 9\033[K\033[2D");
+        CHECK(yash.m_inputCommand == "info 1 2 3 4 5 6 7 9");
+    }
+
+    SECTION("Test backspace at the end of the line")
+    {
+        yash.setCharacter(yash.Backspace);
+        CHECK(output == "\033[D\033[K");
+    }
+}
+
+TEST_CASE("Yash key decoder test")
+{
+    auto decode = [](Yash::KeyDecoder& decoder, std::string_view characters) {
+        std::vector<Yash::Key> keys;
+        for (char character : characters)
+            keys.push_back(decoder.decode(character));
+        return keys;
+    };
+
+    using enum Yash::Key;
+    Yash::KeyDecoder decoder;
+
+    SECTION("Test decoding at compile time")
+    {
+        static_assert([] {
+            Yash::KeyDecoder decoder;
+            decoder.decode('\033');
+            decoder.decode('[');
+            return decoder.decode('A') == Up;
+        }());
+    }
+
+    SECTION("Test the supported key sequences")
+    {
+        std::vector<std::pair<std::string_view, Yash::Key>> sequences { { "\x01", Home }, { "\x05", End }, { "\x0b", DeleteToEnd },
+            { "\x15", DeleteToStart }, { "\x17", DeleteWordLeft }, { "\033[A", Up }, { "\033[B", Down }, { "\033[C", Right }, { "\033[D", Left },
+            { "\033[H", Home }, { "\033[F", End }, { "\033[1~", Home }, { "\033[3~", Delete }, { "\033[4~", End }, { "\033[7~", Home },
+            { "\033[8~", End }, { "\033[1;5C", WordRight }, { "\033[1;5D", WordLeft }, { "\033OA", Up }, { "\033OB", Down }, { "\033OC", Right },
+            { "\033OD", Left }, { "\033OH", Home }, { "\033OF", End }, { "\033b", WordLeft }, { "\033f", WordRight }, { "\033\x7f", DeleteWordLeft } };
+
+        for (auto [sequence, key] : sequences) {
+            std::vector<Yash::Key> keys = decode(decoder, sequence);
+            CHECK(keys.back() == key);
+            CHECK(std::all_of(keys.begin(), keys.end() - 1, [](Yash::Key key) { return key == None; }));
+            CHECK_FALSE(decoder.pending());
+        }
+    }
+
+    SECTION("Test regular characters")
+    {
+        CHECK(decode(decoder, "a[1~\r\x7f") == std::vector { Character, Character, Character, Character, Character, Character });
+    }
+
+    SECTION("Test unknown sequences are skipped")
+    {
+        CHECK(decode(decoder, "\033[99;2Xa") == std::vector { None, None, None, None, None, None, None, Character });
+        CHECK(decode(decoder, "\033[[Aa") == std::vector { None, None, None, Character, Character });
+        CHECK(decode(decoder, "\033OPa") == std::vector { None, None, None, Character });
+        CHECK(decode(decoder, "\033xa") == std::vector { None, None, Character });
+    }
+
+    SECTION("Test control characters abort a sequence")
+    {
+        CHECK(decode(decoder, "\033[1\x01") == std::vector { None, None, None, Home });
+        CHECK(decode(decoder, "\033[\r") == std::vector { None, None, Character });
+        CHECK(decode(decoder, "\033\033[A") == std::vector { None, None, None, Up });
+        CHECK(decode(decoder, "\033O\x7f") == std::vector { None, None, Character });
+    }
+}
+
+TEST_CASE("Yash key bindings test")
+{
+    static constexpr Yash::Config config { .maxRequiredArgs = 3, .commandHistorySize = 10 };
+    static constexpr auto commands = std::to_array<Yash::Command>({
+        { "info", "System info", &info, 0 },
+    });
+
+    std::string output;
+    Yash::Yash<config> yash(commands);
+    yash.setWrite([&](const char* data, size_t size) { output.append(data, size); });
+    yash.feed("info abc def");
+    yash.feed("\033[D\033[D");
+    output.clear();
+
+    SECTION("Test Ctrl-A and Ctrl-E")
+    {
+        yash.feed("\x01");
+        CHECK(output == "\033[10D");
+        CHECK(yash.m_position == 0);
+        output.clear();
+
+        yash.feed("\x05");
+        CHECK(output == "\033[12C");
+        CHECK(yash.m_position == 12);
+    }
+
+    SECTION("Test Ctrl-K")
+    {
+        yash.feed("\x0b");
+        CHECK(output == "\033[K");
+        CHECK(yash.m_inputCommand == "info abc d");
+    }
+
+    SECTION("Test Ctrl-U")
+    {
+        yash.feed("\x15");
+        CHECK(output == "\033[10Def\033[K\033[2D");
+        CHECK(yash.m_inputCommand == "ef");
+        CHECK(yash.m_position == 0);
+    }
+
+    SECTION("Test Ctrl-W and Alt-Backspace")
+    {
+        yash.feed("\x17");
+        CHECK(output == "\033[Def\033[K\033[2D");
+        CHECK(yash.m_inputCommand == "info abc ef");
+        output.clear();
+
+        yash.feed("\033\x7f");
+        CHECK(output == "\033[4Def\033[K\033[2D");
+        CHECK(yash.m_inputCommand == "info ef");
+    }
+
+    SECTION("Test Alt-b and Alt-f")
+    {
+        yash.feed("\033b");
+        CHECK(yash.m_position == 9);
+        yash.feed("\033b");
+        CHECK(yash.m_position == 5);
+        yash.feed("\033f");
+        CHECK(yash.m_position == 8);
+    }
+
+    SECTION("Test Home and End variants")
+    {
+        for (std::string_view home : { "\033[H", "\033OH", "\033[1~", "\033[7~" }) {
+            yash.feed("\x05");
+            yash.feed(home);
+            CHECK(yash.m_position == 0);
+        }
+
+        for (std::string_view end : { "\033[F", "\033OF", "\033[4~", "\033[8~" }) {
+            yash.feed("\x01");
+            yash.feed(end);
+            CHECK(yash.m_position == 12);
+        }
+    }
+
+    SECTION("Test an unknown sequence is ignored")
+    {
+        yash.feed("\033[15~x");
+        CHECK(output == "xef\033[2D");
+        CHECK(yash.m_inputCommand == "info abc dxef");
+    }
+}
+
+namespace {
+
+struct TypedValues {
+    uint8_t address;
+    int16_t offset;
+    bool enable;
+    std::string_view name;
+    std::array<uint8_t, 4> data;
+    size_t dataSize;
+    size_t calls;
+};
+
+TypedValues s_typedValues {};
+
+void untyped()
+{
+    s_typedValues.calls++;
+}
+
+void typed(uint8_t address, int16_t offset, bool enable, std::string_view name, const Yash::HexBytes& data)
+{
+    s_typedValues = { address, offset, enable, name, {}, data.size(), s_typedValues.calls + 1 };
+    for (size_t index = 0; index < std::min(data.size(), s_typedValues.data.size()); index++)
+        s_typedValues.data[index] = data[index];
+}
+
+/// @brief Checks if a typed command can be created for a configuration (which fails if it has too many parameters)
+template <auto TFunction, Yash::Config TConfig>
+concept IsTypedCommandForConfig = requires { Yash::command<TFunction, TConfig>("", ""); };
+
+} // namespace
+
+TEST_CASE("Yash typed command test")
+{
+    static constexpr Yash::Config config { .maxRequiredArgs = 5, .commandHistorySize = 10 };
+    static constexpr auto commands = std::to_array<Yash::Command>({
+        Yash::command<&typed, config>("typed", "Typed command"),
+    });
+
+    // A command with more parameters than the arguments provided by the shell could never be called
+    static constexpr Yash::Config smallConfig { .maxRequiredArgs = 4, .commandHistorySize = 10 };
+    static_assert(IsTypedCommandForConfig<&typed, config>);
+    static_assert(!IsTypedCommandForConfig<&typed, smallConfig>);
+
+    static_assert(commands[0].requiredArguments == 5);
+    static_assert(commands[0].usage == "<u8> <i16> <bool> <string> <hex>");
+    static_assert(Yash::command<&untyped>("untyped", "").requiredArguments == 0);
+    static_assert(Yash::command<&untyped>("untyped", "").usage.empty());
+
+    std::string output;
+    Yash::Yash<config> yash(commands);
+    yash.setWrite([&](const char* data, size_t size) { output.append(data, size); });
+    s_typedValues = {};
+
+    SECTION("Test the arguments are parsed")
+    {
+        output.reserve(256);
+        size_t allocations = s_allocations;
+        yash.feed("typed 0xfF -300 on \"a b\" 0a1B\n");
+        CHECK(s_allocations == allocations);
+        CHECK(s_typedValues.calls == 1);
+        CHECK(s_typedValues.address == 255);
+        CHECK(s_typedValues.offset == -300);
+        CHECK(s_typedValues.enable);
+        CHECK(s_typedValues.name == "a b");
+        CHECK(s_typedValues.dataSize == 2);
+        CHECK(s_typedValues.data[0] == 0x0a);
+        CHECK(s_typedValues.data[1] == 0x1b);
+    }
+
+    SECTION("Test invalid arguments print the usage")
+    {
+        for (std::string_view input : { "typed 256 1 0 a 00\n", "typed 1x 1 0 a 00\n", "typed 1 40000 0 a 00\n", "typed 1 1 yes a 00\n", "typed 1 1 0 a 0\n", "typed 1 1 0 a 0g\n" }) {
+            yash.feed(input);
+            CHECK(s_typedValues.calls == 0);
+        }
+
+        yash.feed("typed 1 1 false a 0g");
+        output.clear();
+        yash.feed("\n");
+        CHECK(output == "\r\nInvalid argument: 0g\r\ntyped  Typed command\r\nUsage: typed <u8> <i16> <bool> <string> <hex>\r\nYash$ ");
+    }
+
+    SECTION("Test too few arguments print the usage")
+    {
+        yash.feed("typed 1 2");
+        output.clear();
+        yash.feed("\n");
+        CHECK(s_typedValues.calls == 0);
+        CHECK(output == "\r\ntyped  Typed command\r\nUsage: typed <u8> <i16> <bool> <string> <hex>\r\nYash$ ");
+    }
+}
+
+namespace {
+
+struct StringSink {
+    std::string* output;
+
+    void operator()(const char* data, size_t size) { output->append(data, size); }
+};
+
+struct FlushingSink : StringSink {
+    size_t* flushes;
+
+    void flush() { ++*flushes; }
+};
+
+/// @brief A non-blocking sink which accepts a limited number of bytes
+struct LimitedSink {
+    std::string* output;
+    size_t* budget; // The number of bytes accepted until the sink is full
+    size_t chunkSize { SIZE_MAX }; // The maximum number of bytes accepted per call
+
+    size_t operator()(const char* data, size_t size)
+    {
+        size = std::min({ size, *budget, chunkSize });
+        output->append(data, size);
+        *budget -= size;
+        return size;
+    }
+};
+
+template <typename T>
+concept HasSetPrint = requires(T& yash) { yash.setPrint(nullptr); };
+
+template <typename T>
+concept HasHistoryStorage = requires(T& yash) { yash.setHistoryStorage({}); };
+
+template <typename T>
+concept HasStatistics = requires(T& yash) { yash.statistics(); };
+
+} // namespace
+
+TEST_CASE("Yash output sink test")
+{
+    static constexpr Yash::Config config { .maxRequiredArgs = 3, .commandHistorySize = 10 };
+    static constexpr Yash::Config bufferedConfig { .maxRequiredArgs = 3, .commandHistorySize = 10, .outputBufferSize = 16 };
+    static constexpr auto commands = std::to_array<Yash::Command>({
+        { "info", "System info", &info, 0 },
+    });
+
+    std::string output;
+
+    SECTION("Test the sink receives the same output as the write function")
+    {
+        std::string expected;
+        Yash::Yash<config> yash(commands);
+        yash.setWrite([&](const char* data, size_t size) { expected.append(data, size); });
+        Yash::Yash<config, StringSink> sinkYash(commands, { &output });
+        static_assert(HasSetPrint<decltype(yash)>);
+        static_assert(!HasSetPrint<decltype(sinkYash)>);
+
+        MOCK_EXPECT(info).exactly(2);
+        for (char character : "in\tfo 1\x7f\033[D\033[1;5Dx\n\x12inf"s) {
+            yash.setCharacter(character);
+            sinkYash.setCharacter(character);
+        }
+
+        CHECK(output == expected);
+        CHECK(sinkYash.sink().output == &output);
+    }
+
+    SECTION("Test the sink is flushed after buffered output")
+    {
+        size_t flushes { 0 };
+        Yash::Yash<bufferedConfig, FlushingSink> yash(commands, { { &output }, &flushes });
+
+        yash.setCharacter('i');
+        CHECK(output == "i");
+        CHECK(flushes == 1);
+
+        yash.print("0123456789abcdefghij");
+        CHECK(output == "i0123456789abcdef");
+        CHECK(flushes == 2);
+
+        yash.flush();
+        CHECK(output == "i0123456789abcdefghij");
+        CHECK(flushes == 3);
+    }
+}
+
+TEST_CASE("Yash session pool test")
+{
+    static constexpr Yash::Config config { .maxRequiredArgs = 3, .commandHistorySize = 10 };
+    static constexpr auto commands = std::to_array<Yash::Command>({
+        { "info", "System info", &info, 0 },
+        { "system reset", "Reset the system", &info, 0 },
+    });
+    static constexpr Yash::CommandTable commandTable { commands };
+    static_assert(commandTable.nameAlignment() == 6);
+
+    std::string firstOutput;
+    std::string secondOutput;
+    Yash::SessionPool<config, 2, StringSink> pool(commandTable);
+    auto* first = pool.open({ &firstOutput });
+    auto* second = pool.open({ &secondOutput });
+
+    SECTION("Test the sessions share the command table")
+    {
+        REQUIRE(first);
+        REQUIRE(second);
+        CHECK(first->m_commands.data() == commands.data());
+        CHECK(second->m_commands.data() == commands.data());
+        CHECK(first->m_allCommandsSizeAlignment == commandTable.nameAlignment());
+    }
+
+    SECTION("Test the number of sessions is limited")
+    {
+        CHECK(pool.size() == 2);
+        CHECK(pool.open({ &firstOutput }) == nullptr);
+
+        pool.close(*first);
+        CHECK(pool.size() == 1);
+        CHECK(pool.open({ &firstOutput }) == first);
+    }
+
+    SECTION("Test the sessions have their own editing state")
+    {
+        pool.feed(*first, "inf");
+        pool.feed(*second, "sys");
+        CHECK(first->m_inputCommand == "inf");
+        CHECK(second->m_inputCommand == "sys");
+        CHECK(firstOutput.ends_with("inf"));
+        CHECK(secondOutput.ends_with("sys"));
+    }
+
+    SECTION("Test the current session is set while handling input")
+    {
+        MOCK_EXPECT(info).once().calls([&](Yash::CommandArgs) { CHECK(pool.current() == second); });
+        pool.feed(*second, "info\n");
+        CHECK(pool.current() == nullptr);
+    }
+
+    SECTION("Test a closed session is opened with a new state")
+    {
+        pool.feed(*first, "inf");
+        pool.close(*first);
+        auto* session = pool.open({ &firstOutput });
+        CHECK(session->m_inputCommand.empty());
+    }
+}
+
+TEST_CASE("Yash server test")
+{
+    static constexpr Yash::Config config { .maxRequiredArgs = 3, .commandHistorySize = 10, .txQueueSize = 256, .txOverflow = Yash::TxOverflow::Truncate };
+    static constexpr auto commands = std::to_array<Yash::Command>({
+        Yash::asyncCommand("dump", "Dump memory", &dump),
+        { "info", "System info", &info, 0 },
+    });
+    static constexpr Yash::CommandTable commandTable { commands };
+
+    Yash::Server<config, 2> server(commandTable);
+    REQUIRE(server.listen(0));
+    REQUIRE(server.port());
+
+    auto connect = [&server] {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(server.port());
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        REQUIRE(::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0);
+        REQUIRE(server.poll(1000));
+        return fd;
+    };
+
+    auto receive = [](int fd) {
+        std::string text;
+        std::array<char, 256> data;
+        ssize_t size;
+        while ((size = ::recv(fd, data.data(), data.size(), MSG_DONTWAIT)) > 0)
+            text.append(data.data(), size);
+
+        return size == 0 && text.empty() ? "EOF"s : text;
+    };
+
+    auto send = [&server](int fd, std::string_view text) {
+        REQUIRE(::send(fd, text.data(), text.size(), 0) == static_cast<ssize_t>(text.size()));
+        REQUIRE(server.poll(1000));
+    };
+
+    int first = connect();
+    int second = connect();
+    CHECK(receive(first) == "Yash$ ");
+    CHECK(receive(second) == "Yash$ ");
+    CHECK(server.pool().size() == 2);
+
+    SECTION("Test each connection has its own session")
+    {
+        send(first, "inf");
+        CHECK(receive(first).ends_with("inf"));
+        CHECK(receive(second).empty());
+
+        MOCK_EXPECT(info).once().calls([&](Yash::CommandArgs) {
+            REQUIRE(server.current());
+            CHECK(server.current()->sink().fd != -1);
+            server.current()->print("second");
+        });
+        send(second, "info\n");
+        CHECK(receive(second).ends_with("info\r\nsecondYash$ "));
+        CHECK(receive(first).empty());
+    }
+
+    SECTION("Test connections are refused when all sessions are open")
+    {
+        int third = connect();
+        CHECK(receive(third) == "EOF");
+        CHECK(server.pool().size() == 2);
+        ::close(third);
+    }
+
+    SECTION("Test the session is closed with the connection")
+    {
+        ::close(first);
+        REQUIRE(server.poll(1000));
+        CHECK(server.pool().size() == 1);
+
+        first = connect();
+        CHECK(receive(first) == "Yash$ ");
+        CHECK(server.pool().size() == 2);
+    }
+
+    SECTION("Test an asynchronous command is stepped without spinning")
+    {
+        size_t steps { 0 };
+        MOCK_EXPECT(dump).calls([&](Yash::CommandArgs, Yash::CommandState& state) { steps = state.step + 1; return steps == 3; });
+        send(first, "dump\n");
+
+        // Each poll waits for the step interval instead of returning at once or waiting for input
+        auto start = std::chrono::steady_clock::now();
+        for (size_t round = 0; round < 10 && steps < 3; round++)
+            REQUIRE(server.poll(-1));
+
+        CHECK(steps == 3);
+        CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(1));
+        CHECK(receive(first).ends_with("Yash$ "));
+    }
+
+    SECTION("Test a client which does not read its output does not stall the other sessions")
+    {
+        // Small socket buffers of the first session so the output of a command fills them
+        int bufferSize { 1024 };
+        ::setsockopt(first, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+        ::setsockopt(server.pool().m_sessions[0]->sink().fd, SOL_SOCKET, SO_SNDBUF, &bufferSize, sizeof(bufferSize));
+
+        const std::string text(16000, 'x');
+        MOCK_EXPECT(info).calls([&](Yash::CommandArgs) { server.current()->print(text.c_str()); });
+        for (size_t command = 0; command < 100 && !server.pool().m_sessions[0]->txPaused(); command++)
+            send(first, "info\n");
+
+        Yash::Server<config, 2>::Session& session = *server.pool().m_sessions[0];
+        REQUIRE(session.txPaused());
+        CHECK(session.txDropped() > 0);
+
+        send(second, "info\n");
+        CHECK(receive(second).ends_with(text + "Yash$ "));
+        mock::reset(); // the expectation refers to the text and the server
+
+        // The queued output is written when the client reads (ending with the marker of the truncated output)
+        std::string output = receive(first);
+        for (size_t round = 0; round < 100 && session.txQueued(); round++) {
+            REQUIRE(server.poll(1000));
+            output += receive(first);
+        }
+
+        CHECK(session.txQueued() == 0);
+        CHECK(output.ends_with("...\r\n"));
+
+        // The input is read again
+        send(first, "\n");
+        CHECK(receive(first) == "\r\nYash$ ");
+    }
+
+    ::close(first);
+    ::close(second);
+}
+
+TEST_CASE("Yash input queue test")
+{
+    SECTION("Test overflows are counted")
+    {
+        Yash::InputQueue<8> queue;
+        for (char character : "0123456789"s)
+            queue.push(character);
+
+        CHECK(queue.size() == 8);
+        CHECK(queue.overflows() == 2);
+
+        std::array<char, 5> characters;
+        CHECK(queue.pop(characters) == 5);
+        CHECK(std::string_view(characters.data(), 5) == "01234");
+
+        // The positions wrap around the end of the queue
+        for (char character : "abcdef"s)
+            CHECK(queue.push(character) == (character != 'f'));
+
+        std::array<char, 16> remaining;
+        CHECK(queue.pop(remaining) == 8);
+        CHECK(std::string_view(remaining.data(), 8) == "567abcde");
+        CHECK(queue.pop(remaining) == 0);
+        CHECK(queue.overflows() == 3);
+    }
+
+    SECTION("Test the order is kept when the positions wrap around")
+    {
+        Yash::InputQueue<8> queue;
+        queue.m_head = queue.m_tail = SIZE_MAX - 2;
+        for (char character : "012345"s)
+            CHECK(queue.push(character));
+
+        std::array<char, 8> characters;
+        CHECK(queue.pop(characters) == 6);
+        CHECK(std::string_view(characters.data(), 6) == "012345");
+        CHECK(queue.size() == 0);
+    }
+
+    SECTION("Test the queue is lock-free from two threads")
+    {
+        static constexpr size_t count { 100000 };
+        Yash::InputQueue<64> queue;
+        static_assert(std::atomic<size_t>::is_always_lock_free);
+
+        size_t failedPushes { 0 };
+        std::thread producer([&] {
+            for (size_t index = 0; index < count; index++) {
+                while (!queue.push(static_cast<char>(index % 251))) {
+                    failedPushes++;
+                    std::this_thread::yield();
+                }
+            }
+        });
+
+        size_t received { 0 };
+        bool ordered { true };
+        std::array<char, 16> characters;
+        while (received < count) {
+            size_t size = queue.pop(characters);
+            if (!size)
+                std::this_thread::yield();
+            for (size_t index = 0; index < size; index++)
+                ordered = ordered && characters[index] == static_cast<char>((received + index) % 251);
+            received += size;
+        }
+
+        producer.join();
+        CHECK(ordered);
+        CHECK(queue.size() == 0);
+        CHECK(queue.overflows() == failedPushes);
+    }
+
+    SECTION("Test the shell polls characters pushed from another thread")
+    {
+        static constexpr Yash::Config config { .maxRequiredArgs = 3, .commandHistorySize = 10, .inputQueueSize = 32 };
+        static constexpr auto commands = std::to_array<Yash::Command>({
+            { "info", "System info", &info, 0 },
+        });
+        static constexpr size_t count { 1000 };
+
+        std::string output;
+        Yash::Yash<config> yash(commands);
+        yash.setWrite([&](const char* data, size_t size) { output.append(data, size); });
+
+        std::thread producer([&yash] {
+            auto& queue = yash.inputQueue();
+            for (size_t index = 0; index < count; index++) {
+                for (char character : "info\n"s) {
+                    while (!queue.push(character))
+                        std::this_thread::yield();
+                }
+            }
+        });
+
+        size_t calls { 0 };
+        MOCK_EXPECT(info).exactly(count).calls([&calls](Yash::CommandArgs) { calls++; });
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (calls < count && std::chrono::steady_clock::now() < deadline) {
+            if (!yash.poll())
+                std::this_thread::yield();
+        }
+
+        producer.join();
+        CHECK(calls == count);
+        CHECK(yash.poll() == 0);
+    }
+}
+
+TEST_CASE("Yash async command test")
+{
+    static constexpr Yash::Config config { .maxRequiredArgs = 3, .commandHistorySize = 10 };
+    static constexpr auto commands = std::to_array<Yash::Command>({
+        Yash::asyncCommand("dump", "Flash dump <blocks>", &dump, 1),
+        { "info", "System info", &info, 0 },
+    });
+
+    std::string output;
+    std::optional<Yash::Yash<config>> yash(std::in_place, Yash::CommandTable { commands });
+    yash->setWrite([&](const char* data, size_t size) { output.append(data, size); });
+    yash->setPrompt("$ ");
+
+    auto type = [&yash](std::string_view characters) {
+        for (char character : characters)
+            yash->setCharacter(character);
+    };
+
+    SECTION("Test the command is stepped until it is done")
+    {
+        MOCK_EXPECT(dump).exactly(3).calls([](Yash::CommandArgs args, Yash::CommandState& state) {
+            CHECK(args.size() == 1);
+            CHECK(args[0] == "3");
+            CHECK(!state.cancelled);
+            state.value += 0x100;
+            return state.step == 2;
+        });
+
+        type("dump 3\n");
+        CHECK(yash->busy());
+        CHECK(yash->poll() == 0);
+        CHECK(yash->busy());
+        CHECK(output == "dump 3\r\n");
+
+        yash->poll();
+        CHECK(!yash->busy());
+        CHECK(yash->m_async.state.value == 0x300);
+        CHECK(output == "dump 3\r\n$ ");
+
+        yash->poll();
+        CHECK(output == "dump 3\r\n$ ");
+    }
+
+    SECTION("Test a command done in the first step prints the prompt right away")
+    {
+        MOCK_EXPECT(dump).once().returns(true);
+        type("dump 1\n");
+        CHECK(!yash->busy());
+        CHECK(output == "dump 1\r\n$ ");
+    }
+
+    SECTION("Test too few arguments print the usage")
+    {
+        MOCK_EXPECT(dump).never();
+        type("dump\n");
+        CHECK(!yash->busy());
+        CHECK(output == "dump\r\ndump  Flash dump <blocks>\r\n$ ");
+    }
+
+    SECTION("Test the input typed ahead is handled when the command is done")
+    {
+        MOCK_EXPECT(dump).exactly(2).calls([](Yash::CommandArgs, Yash::CommandState& state) { return state.step == 1; });
+        type("dump 2\n");
+        yash->feed("inf");
+        yash->setCharacter('o');
+        type("\n");
+        CHECK(yash->m_typeAhead == "info\n");
+        CHECK(output == "dump 2\r\n");
+
+        MOCK_EXPECT(info).once();
+        yash->poll();
+        CHECK(yash->m_typeAhead.empty());
+        CHECK(output == "dump 2\r\n$ info\r\n$ ");
+    }
+
+    SECTION("Test Ctrl-C cancels the command and the input typed ahead")
+    {
+        size_t cancelled { 0 };
+        MOCK_EXPECT(dump).exactly(2).calls([&cancelled](Yash::CommandArgs, Yash::CommandState& state) {
+            cancelled += state.cancelled;
+            return false;
+        });
+        MOCK_EXPECT(info).never();
+
+        type("dump 9\n");
+        type("info\n");
+        yash->setCharacter('\x03');
+        CHECK(cancelled == 1);
+        CHECK(!yash->busy());
+        CHECK(output == "dump 9\r\n^C\r\n$ ");
+
+        yash->poll();
+        CHECK(output == "dump 9\r\n^C\r\n$ ");
+    }
+
+    SECTION("Test the command is cancelled when the shell is destroyed")
+    {
+        size_t cancelled { 0 };
+        MOCK_EXPECT(dump).exactly(2).calls([&cancelled](Yash::CommandArgs, Yash::CommandState& state) {
+            cancelled += state.cancelled;
+            return false;
+        });
+
+        type("dump 9\n");
+        yash.reset();
+        CHECK(cancelled == 1);
+        CHECK(output == "dump 9\r\n");
+    }
+
+    SECTION("Test the session pool steps the commands of its sessions")
+    {
+        static constexpr Yash::CommandTable commandTable { commands };
+        Yash::SessionPool<config, 2> pool(commandTable);
+        auto* session = pool.open();
+        pool.open();
+
+        MOCK_EXPECT(dump).exactly(2).calls([&](Yash::CommandArgs, Yash::CommandState& state) {
+            CHECK(pool.current() == session);
+            return state.step == 1;
+        });
+
+        pool.feed(*session, "dump 2\n");
+        CHECK(pool.poll() == false);
+        CHECK(!session->busy());
+        CHECK(pool.poll() == false);
+    }
+}
+
+namespace {
+
+void hexDump(Yash::Output& output, uint16_t address, uint8_t size)
+{
+    for (uint8_t index = 0; index < size; index++)
+        output.format("{:04x}: {:02X}\n", address + index, index);
+}
+
+bool asyncHexDump(Yash::CommandArgs /* unused */, Yash::CommandState& state)
+{
+    state.output.format("block {}\n", state.step);
+    return state.step == 1;
+}
+
+void echo(Yash::CommandArgs args, Yash::Output& output)
+{
+    for (std::string_view arg : args)
+        output.format("[{}]", arg);
+    output.write("\n");
+}
+
+int verify(Yash::CommandArgs args, Yash::Output& output)
+{
+    output.format("{} is invalid\n", args[0]);
+    return Yash::Failure;
+}
+
+} // namespace
+
+TEST_CASE("Yash output format test")
+{
+    auto format = [](std::string_view text, const auto&... args) {
+        std::array<char, 64> buffer;
+        size_t size = Yash::formatTo(buffer, text, args...);
+        return std::string(buffer.data(), std::min(size, buffer.size()));
+    };
+
+    SECTION("Test replacement fields are formatted")
+    {
+        CHECK(format("{} {} {} {}", -42, true, 'c', "text") == "-42 true c text");
+        CHECK(format("{} {}", std::string_view { "view" }, uint64_t { UINT64_MAX }) == "view 18446744073709551615");
+        CHECK(format("{1} {0} {}", 1, 2) == "2 1 1");
+        CHECK(format("{{}} } {") == "{} } {");
+        CHECK(format("{} {}", 1) == "1 ");
+    }
+
+    SECTION("Test format specifications")
+    {
+        CHECK(format("{:08x}", 0xbeefU) == "0000beef");
+        CHECK(format("{:X} {:o} {:b}", 255, 8, 5) == "FF 10 101");
+        CHECK(format("{:05}", -42) == "-0042");
+        CHECK(format("[{:6}] [{:<6}] [{:^6}]", 42, 42, 42) == "[    42] [42    ] [  42  ]");
+        CHECK(format("[{:6}] [{:>6}] [{:*^7}]", "ab", "ab", "ab") == "[ab    ] [    ab] [**ab***]");
+        CHECK(format("{:020}", 1) == "00000000000000000001");
+    }
+
+    SECTION("Test the text is truncated like std::format_to_n")
+    {
+        std::array<char, 4> buffer;
+        CHECK(Yash::formatTo(buffer, "{}-{}", 123, 456) == 7);
+        CHECK(std::string_view(buffer.data(), buffer.size()) == "123-");
+    }
+
+    SECTION("Test the output writes line feeds as carriage return and line feed")
+    {
+        std::string output;
+        Yash::Output writer(&output, [](void* context, const char* data, size_t size) { static_cast<std::string*>(context)->append(data, size); });
+        writer.write("a\nb\r\nc\r");
+        writer.write("\n\n");
+        writer.format("{}\n{}", 1, 2);
+        CHECK(output == "a\r\nb\r\nc\r\n\r\n1\r\n2");
+
+        Yash::Output unused;
+        unused.write("text\n");
+    }
+
+    SECTION("Test commands write and format through the shell")
+    {
+        static constexpr Yash::Config config { .maxRequiredArgs = 3, .commandHistorySize = 10, .outputBufferSize = 64 };
+        static constexpr auto commands = std::to_array<Yash::Command>({
+            Yash::asyncCommand("async", "Async hex dump", &asyncHexDump),
+            Yash::command<&hexDump>("dump", "Hex dump"),
+            Yash::outputCommand("echo", "Echo the arguments", &echo),
+            Yash::statusCommand("verify", "Verify a value", &verify, 1),
+        });
+
+        static_assert(commands[1].requiredArguments == 2);
+        static_assert(commands[1].usage == "<u16> <u8>");
+
+        std::string output;
+        std::vector<size_t> writes;
+        Yash::Yash<config> yash(commands);
+        yash.setWrite([&](const char* data, size_t size) {
+            output.append(data, size);
+            writes.push_back(size);
+        });
+        yash.setPrompt("$ ");
+
+        output.reserve(256);
+        writes.reserve(16);
+        size_t allocations = s_allocations;
+        yash.setCharacters({ "dump 0x1ffe 3\n", 14 });
+        CHECK(s_allocations == allocations);
+        CHECK(output == "dump 0x1ffe 3\r\n1ffe: 00\r\n1fff: 01\r\n2000: 02\r\n$ ");
+        CHECK(writes.size() == 2); // the output of the command is buffered until the buffer is full
+
+        output.clear();
+        yash.setCharacters({ "async\n", 6 });
+        yash.poll();
+        CHECK(output == "async\r\nblock 0\r\nblock 1\r\n$ ");
+
+        output.clear();
+        CHECK(yash.runScript("echo a \"b c\"\nverify 42 && echo no").failedLine == 2);
+        CHECK(output == "[a][b c]\r\n42 is invalid\r\n");
+        CHECK(yash.status() == Yash::Failure);
+    }
+
+    SECTION("Test the text is formatted into the output buffer until it is full")
+    {
+        static constexpr Yash::Config config { .maxRequiredArgs = 3, .commandHistorySize = 10, .outputBufferSize = 8 };
+        static constexpr auto commands = std::to_array<Yash::Command>({
+            { "info", "System info", &info, 0 },
+        });
+
+        std::string output;
+        std::vector<size_t> writes;
+        Yash::Yash<config> yash(commands);
+        yash.setWrite([&](const char* data, size_t size) {
+            output.append(data, size);
+            writes.push_back(size);
+        });
+
+        Yash::Output writer = yash.output();
+        writer.write("ab");
+        writer.format("{}\n{:>8}\n", 12345, "x");
+        writer.format("\n");
+        yash.flush();
+        CHECK(output == "ab12345\r\n       x\r\n\r\n");
+        CHECK(writes == std::vector<size_t> { 7, 7, 7 }); // flushed when less than a "\r\n" fits
+    }
+}
+
+TEST_CASE("Yash completion test")
+{
+    static constexpr Yash::Config config { .maxRequiredArgs = 3, .commandHistorySize = 10 };
+    static constexpr auto commands = std::to_array<Yash::Command>({
+        { "info", "System info", &info, 0 },
+        { "net eth up", "Ethernet up", &info, 0 },
+        { "net wifi join", "Join a network", &info, 0 },
+        { "net wifi scan", "Scan for networks", &info, 0 },
+        { "system reboot", "Reboot the system", &info, 0 },
+        { "system reset", "Reset the system", &info, 0 },
+    });
+
+    static_assert([] {
+        size_t names { 0 };
+        Yash::Yash<config>::forEachCandidate(commands, 0, [&names](std::string_view, const Yash::Command*) { names++; });
+        return names;
+    }() == 3);
+
+    std::string output;
+    Yash::Yash<config> yash(commands);
+    yash.setWrite([&](const char* data, size_t size) { output.append(data, size); });
+    yash.setPrompt("$ ");
+
+    auto type = [&yash](std::string_view characters) {
+        for (char character : characters)
+            yash.setCharacter(character);
+    };
+
+    SECTION("Test the input is completed to the longest common prefix")
+    {
+        type("sys\t");
+        CHECK(yash.m_inputCommand == "system re");
+        CHECK(output == "sys\r\033[K$ system re");
+
+        type("b\t");
+        CHECK(yash.m_inputCommand == "system reboot ");
+    }
+
+    SECTION("Test the completion continues with the next word")
+    {
+        type("n\t");
+        CHECK(yash.m_inputCommand == "net ");
+
+        type("w\t");
+        CHECK(yash.m_inputCommand == "net wifi ");
+    }
+
+    SECTION("Test a double TAB lists the candidates grouped by the next word")
+    {
+        type("net \t");
+        CHECK(output == "net ");
+
+        type("\t");
+        CHECK(output == "net \r\nnet eth   Net eth commands\r\nnet wifi  Net wifi commands\r\n\r\033[K$ net ");
+        CHECK(yash.m_inputCommand == "net ");
+
+        output.clear();
+        type("wifi \t\t");
+        CHECK(output == "wifi \r\nnet wifi join  Join a network\r\nnet wifi scan  Scan for networks\r\n\r\033[K$ net wifi ");
+    }
+
+    SECTION("Test a double TAB on empty input lists all commands")
+    {
+        type("\t\t");
+        CHECK(output == "\r\ninfo    System info\r\nnet     Net commands\r\nsystem  System commands\r\n\r\033[K$ ");
+    }
+
+    SECTION("Test other characters between the TABs do not list the candidates")
+    {
+        type("net \tx\x7f\t");
+        CHECK(output == "net x\033[D\033[K");
+
+        type("\t");
+        CHECK(output.ends_with("\r\033[K$ net "));
+    }
+
+    SECTION("Test no candidates are printed for unknown input")
+    {
+        type("x\t\t");
+        CHECK(output == "x");
+    }
+}
+
+namespace {
+
+size_t s_pinCompletions { 0 };
+
+void completePins(Yash::CommandArgs /* unused */, Yash::Completions& completions)
+{
+    // The candidates are generated lazily until no more are wanted
+    for (size_t pin = 0; pin < 32; pin++) {
+        std::array<char, 4> text;
+        s_pinCompletions++;
+        if (!completions.add({ text.data(), Yash::formatTo(text, "{}", pin) }))
+            return;
+    }
+}
+
+void completeColors(Yash::CommandArgs args, Yash::Completions& completions)
+{
+    if (args.size() == 1 && args[0] == "all")
+        completions.add("all");
+    else {
+        for (std::string_view color : { "blue", "green", "greenish", "red" })
+            completions.add(color);
+    }
+}
+
+} // namespace
+
+TEST_CASE("Yash argument completion test")
+{
+    static constexpr Yash::Config config { .maxRequiredArgs = 3, .commandHistorySize = 10, .maxCompletions = 12 };
+    static constexpr auto commands = std::to_array<Yash::Command>({
+        { "gpio set", "GPIO set <pin>", &info, 1, &completePins },
+        { "led", "LED <led> <color>", &info, 2, &completeColors },
+        { "reset", "Reset", &info, 0 },
+    });
+
+    std::string output;
+    Yash::Yash<config> yash(commands);
+    yash.setWrite([&](const char* data, size_t size) { output.append(data, size); });
+    yash.setPrompt("$ ");
+    s_pinCompletions = 0;
+
+    auto type = [&yash](std::string_view characters) {
+        for (char character : characters)
+            yash.setCharacter(character);
+    };
+
+    SECTION("Test the candidates are collected in the buffer")
+    {
+        std::array<char, 16> buffer;
+        Yash::Completions completions { "gr", buffer, 3 };
+        CHECK(completions.add("blue"));
+        CHECK(completions.add("green"));
+        CHECK(completions.add("greenish"));
+        CHECK(completions.common() == "green");
+        CHECK(!completions.add("grey-ish"));
+        CHECK(completions.truncated());
+        CHECK(completions.size() == 2);
+
+        std::string candidates;
+        completions.forEach([&candidates](std::string_view candidate) { candidates += std::string(candidate) + ","; });
+        CHECK(candidates == "green,greenish,");
+    }
+
+    SECTION("Test a single candidate is completed with a delimiter")
+    {
+        type("led 1 b\t");
+        CHECK(yash.m_inputCommand == "led 1 blue ");
+    }
+
+    SECTION("Test the argument is completed to the common prefix")
+    {
+        type("led 1 g\t");
+        CHECK(yash.m_inputCommand == "led 1 green");
+
+        type("\t\t");
+        CHECK(output.ends_with("\r\ngreen\r\ngreenish\r\n\r\033[K$ led 1 green"));
+    }
+
+    SECTION("Test the arguments before the completed argument are passed")
+    {
+        type("led all \t");
+        CHECK(yash.m_inputCommand == "led all all ");
+    }
+
+    SECTION("Test the provider stops when no more candidates are wanted")
+    {
+        type("gpio set \t");
+        CHECK(yash.m_inputCommand == "gpio set ");
+        CHECK(s_pinCompletions == config.maxCompletions + 1);
+
+        output.clear();
+        type("\t");
+        CHECK(output == "\r\n0\r\n1\r\n2\r\n3\r\n4\r\n5\r\n6\r\n7\r\n8\r\n9\r\n10\r\n11\r\n...\r\n\r\033[K$ gpio set ");
+    }
+
+    SECTION("Test the candidates are narrowed by the typed part of the argument")
+    {
+        type("gpio set 2\t\t");
+        CHECK(output.ends_with("\r\n2\r\n20\r\n21\r\n22\r\n23\r\n24\r\n25\r\n26\r\n27\r\n28\r\n29\r\n\r\033[K$ gpio set 2"));
+
+        type("5\t");
+        CHECK(yash.m_inputCommand == "gpio set 25 ");
+    }
+
+    SECTION("Test commands without a provider print the command")
+    {
+        type("reset \t");
+        CHECK(output == "reset \r\nreset  Reset\r\n\r\033[K$ reset ");
+    }
+
+    SECTION("Test no allocations when completing arguments")
+    {
+        output.reserve(256);
+        size_t allocations = s_allocations;
+        type("gpio set 1\t\t");
+        CHECK(s_allocations == allocations);
+    }
+}
+
+TEST_CASE("Yash feature flags test")
+{
+    static constexpr Yash::Config fullConfig { .maxRequiredArgs = 3, .commandHistorySize = 10 };
+    static constexpr Yash::Config minimalConfig { .maxRequiredArgs = 3, .commandHistorySize = 0, .editing = false, .keySequences = false, .completion = false, .help = false, .asyncCommands = false };
+    static constexpr auto commands = std::to_array<Yash::Command>({
+        { "info", "System info", &info, 0 },
+    });
+
+    using MinimalYash = Yash::Yash<minimalConfig, StringSink>;
+
+    // A command holds one function (where the kind tells which)
+    static_assert(sizeof(Yash::Command) == 3 * sizeof(std::string_view) + 4 * sizeof(void*));
+
+    // Disabled features take no space
+    static_assert(std::is_empty_v<decltype(MinimalYash::m_history)>);
+    static_assert(std::is_empty_v<decltype(MinimalYash::m_output)>);
+    static_assert(std::is_empty_v<decltype(MinimalYash::m_keyDecoder)>);
+    static_assert(sizeof(MinimalYash) < sizeof(Yash::Yash<fullConfig, StringSink>));
+    static_assert(!HasHistoryStorage<MinimalYash>);
+    static_assert(std::is_empty_v<decltype(MinimalYash::m_statistics)>);
+    static_assert(!HasStatistics<MinimalYash>);
+    static_assert(std::is_empty_v<decltype(MinimalYash::m_async)>);
+    static_assert(std::is_empty_v<decltype(MinimalYash::m_typeAhead)>);
+
+    std::string output;
+    auto type = [](auto& yash, std::string_view characters) {
+        for (char character : characters)
+            yash.setCharacter(character);
+    };
+
+    SECTION("Test editing keys are ignored when editing is disabled")
+    {
+        static constexpr Yash::Config config { .maxRequiredArgs = 3, .commandHistorySize = 10, .editing = false };
+        Yash::Yash<config, StringSink> yash(commands, { &output });
+        yash.setPrompt("$ ");
+
+        type(yash, "in\033[D\033[H\x01\x0b" "fo");
+        CHECK(yash.m_inputCommand == "info");
+        CHECK(output == "info");
+
+        // The history can still be recalled
+        MOCK_EXPECT(info).once();
+        type(yash, "\n\033[A");
+        CHECK(yash.m_inputCommand == "info");
+    }
+
+    SECTION("Test control characters are ignored when key sequences are disabled")
+    {
+        MinimalYash yash(commands, { &output });
+        yash.setPrompt("$ ");
+
+        type(yash, "in\x01\x12\t\033" "fo");
+        CHECK(yash.m_inputCommand == "info");
+
+        type(yash, "\x7f\x03");
+        CHECK(yash.m_inputCommand.empty());
+    }
+
+    SECTION("Test the commands are not listed when help is disabled")
+    {
+        MinimalYash yash(commands, { &output });
+        yash.setPrompt("$ ");
+
+        type(yash, "foo\n");
+        CHECK(output == "foo\r\nCommand not found: foo\r\n$ ");
+    }
+
+    SECTION("Test the shell is never busy when asynchronous commands are disabled")
+    {
+        static constexpr auto asyncCommands = std::to_array<Yash::Command>({
+            Yash::asyncCommand("async", "Async hex dump", &asyncHexDump),
+            { "info", "System info", &info, 0 },
+        });
+
+        MinimalYash yash(asyncCommands, { &output });
+        yash.setPrompt("$ ");
+
+        MOCK_EXPECT(info).once();
+        type(yash, "info\n");
+        CHECK_FALSE(yash.busy());
+        CHECK(yash.poll() == 0);
+        CHECK(output == "info\r\n$ ");
+
+        // An asynchronous command fails without being called
+        type(yash, "async\n");
+        CHECK_FALSE(yash.busy());
+        CHECK(yash.status() == Yash::Failure);
+    }
+}
+
+TEST_CASE("Yash script test")
+{
+    static constexpr Yash::Config config { .maxRequiredArgs = 3, .commandHistorySize = 10, .maxCommandLength = 32 };
+    static constexpr auto commands = std::to_array<Yash::Command>({
+        Yash::asyncCommand("async", "Async hex dump", &asyncHexDump),
+        Yash::command<&hexDump>("dump", "Hex dump"),
+        { "i2c read", "I2C read <addr> <reg> <bytes>", &i2c, 3 },
+        { "info", "System info", &info, 0 },
+    });
+
+    std::string output;
+    Yash::Yash<config, StringSink> yash(commands, { &output });
+    yash.setPrompt("$ ");
+
+    SECTION("Test the commands are run without echo and prompts")
+    {
+        yash.feed("inf");
+        output.clear();
+
+        MOCK_EXPECT(info).once();
+        MOCK_EXPECT(i2c).once().with([](Yash::CommandArgs args) { return args.size() == 3 && args[2] == "3"; });
+        Yash::ScriptResult result = yash.runScript("# Read the info\n\ninfo\r\n  i2c read 1 2 3\ndump 16 1");
+        CHECK(result);
+        CHECK(result.commands == 3);
+        CHECK(output == "0010: 00\r\n");
+
+        // The history and the input line being edited are kept
+        CHECK(yash.m_history.entries.size() == 0);
+        CHECK(yash.m_inputCommand == "inf");
+    }
+
+    SECTION("Test the failed lines are counted")
+    {
+        MOCK_EXPECT(info).exactly(2);
+        Yash::ScriptResult result = yash.runScript("info\nfoo\ni2c read 1\ndump 1 x\ninfo\n");
+        CHECK(!result);
+        CHECK(result.commands == 4);
+        CHECK(result.failures == 3);
+        CHECK(result.failedLine == 2);
+        CHECK(output == "Command not found: foo\r\n"
+                        "i2c read  I2C read <addr> <reg> <bytes>\r\n"
+                        "Invalid argument: x\r\n"
+                        "dump  Hex dump\r\n"
+                        "Usage: dump <u16> <u8>\r\n");
+    }
+
+    SECTION("Test the script stops at the first failure when asked")
+    {
+        MOCK_EXPECT(info).once();
+        Yash::ScriptResult result = yash.runScript("info\n0123456789012345678901234567890123456789\ninfo\n", true);
+        CHECK(result.commands == 1);
+        CHECK(result.failedLine == 2);
+        CHECK(output == "Line too long\r\n");
+    }
+
+    SECTION("Test asynchronous commands are stepped until they are done")
+    {
+        CHECK(yash.runScript("async\nasync"));
+        CHECK(output == "block 0\r\nblock 1\r\nblock 0\r\nblock 1\r\n");
+        CHECK(!yash.busy());
+    }
+
+    SECTION("Test a script is tokenized in place")
+    {
+        MOCK_EXPECT(info).once();
+        MOCK_EXPECT(i2c).once().with([](Yash::CommandArgs args) { return args.size() == 3 && args[0] == "a b" && args[2] == "3"; });
+        std::string script = "i2c read \"a b\" 2 3\r\ndump 16 1 && info\ndump 32 2";
+        Yash::ScriptResult result = yash.runScriptInPlace(script);
+        CHECK(result);
+        CHECK(result.commands == 4);
+        CHECK(output == "0010: 00\r\n0020: 00\r\n0021: 01\r\n");
+
+        // The last line is copied as it can not be terminated in place
+        CHECK(script.ends_with("dump 32 2"));
+    }
+
+    SECTION("Test a script file is run")
+    {
+        std::string path = (std::filesystem::temp_directory_path() / "yash-script-test").string();
+        if (std::FILE* file = std::fopen(path.c_str(), "wb")) {
+            std::fputs("# Provisioning\ninfo\ninfo\n", file);
+            std::fclose(file);
+        }
+
+        MOCK_EXPECT(info).exactly(2);
+        std::optional<Yash::ScriptResult> result = Yash::runScriptFile(yash, path.c_str());
+        REQUIRE(result);
+        CHECK(result->commands == 2);
+        std::filesystem::remove(path);
+
+        CHECK(!Yash::runScriptFile(yash, path.c_str()));
+    }
+}
+
+namespace {
+
+uint64_t s_clock { 0 };
+
+uint64_t clock()
+{
+    return s_clock += 10;
+}
+
+int setLevel(Yash::Output& output, uint8_t level)
+{
+    output.format("level {}\n", level);
+    return level > 3 ? Yash::InvalidArguments : Yash::Success;
+}
+
+} // namespace
+
+TEST_CASE("Yash chaining test")
+{
+    static constexpr Yash::Config config { .maxRequiredArgs = 3, .commandHistorySize = 10 };
+    static constexpr auto commands = std::to_array<Yash::Command>({
+        Yash::statusCommand("check", "Check <value>", &check, 1),
+        Yash::asyncCommand("dump", "Flash dump <blocks>", &dump, 1),
+        { "info", "System info", &info, 0 },
+        Yash::command<&setLevel>("level", "Set the level"),
+    });
+
+    std::string output;
+    Yash::Yash<config, StringSink> yash(commands, { &output });
+    yash.setPrompt("$ ");
+
+    auto type = [&yash](std::string_view characters) {
+        for (char character : characters)
+            yash.setCharacter(character);
+    };
+
+    auto checkValue = [](Yash::CommandArgs args) { return args[0] == "ok" ? Yash::Success : Yash::Failure; };
+
+    SECTION("Test the commands are run depending on the status of the previous command")
+    {
+        MOCK_EXPECT(check).exactly(5).calls(checkValue);
+        MOCK_EXPECT(info).exactly(3);
+
+        type("check ok && info\n");
+        CHECK(yash.status() == Yash::Success);
+
+        type("check fail && info\n");
+        CHECK(yash.status() == Yash::Failure);
+
+        type("check fail || info; info\n");
+        CHECK(yash.status() == Yash::Success);
+
+        // A skipped command keeps the status for the following operator
+        type("check fail && info && info || check ok\n");
+        CHECK(yash.status() == Yash::Success);
+    }
+
+    SECTION("Test quoted and escaped operators are passed as arguments")
+    {
+        MOCK_EXPECT(check).once().with([](Yash::CommandArgs args) { return args.size() == 2 && args[0] == "a;b" && args[1] == "&&"; }).returns(0);
+        type("check \"a;b\" \\&&\n");
+        CHECK(yash.status() == Yash::Success);
+    }
+
+    SECTION("Test the status of typed commands, unknown commands and invalid arguments")
+    {
+        type("level 2\n");
+        CHECK(yash.status() == Yash::Success);
+        type("level 4\n");
+        CHECK(yash.status() == Yash::InvalidArguments);
+        type("level x\n");
+        CHECK(yash.status() == Yash::InvalidArguments);
+        type("foo\n");
+        CHECK(yash.status() == Yash::NotFound);
+
+        output.clear();
+        MOCK_EXPECT(info).once();
+        type("foo || info\n");
+        CHECK(output == "foo || info\r\ncheck  Check <value>\r\ndump   Flash dump <blocks>\r\ninfo   System info\r\nlevel  Set the level\r\n$ ");
+    }
+
+    SECTION("Test a command is repeated until it fails")
+    {
+        MOCK_EXPECT(info).exactly(6);
+        type("repeat 3 info; repeat 0x3 info\n");
+
+        size_t calls { 0 };
+        MOCK_EXPECT(check).exactly(3).calls([&calls](Yash::CommandArgs) { return ++calls == 3 ? Yash::Failure : Yash::Success; });
+        output.clear();
+        type("repeat 10 check x\n");
+        CHECK(yash.status() == Yash::Failure);
+        CHECK(output == "repeat 10 check x\r\nFailed in iteration 3\r\n$ ");
+
+        output.clear();
+        type("repeat x info\n");
+        CHECK(yash.status() == Yash::InvalidArguments);
+        CHECK(output == "repeat x info\r\nUsage: repeat <count> <command>\r\n$ ");
+    }
+
+    SECTION("Test commands are timed with the clock")
+    {
+        MOCK_EXPECT(info).exactly(5);
+        type("time info\n");
+        CHECK(output == "time info\r\nNo clock set for timing\r\n$ ");
+
+        yash.setClock(&clock);
+        output.clear();
+        type("time info\n");
+        CHECK(output == "time info\r\nTime: 10 us\r\n$ ");
+
+        output.clear();
+        type("repeat 2 time level 1\n");
+        CHECK(output == "repeat 2 time level 1\r\nlevel 1\r\nTime: 10 us\r\nlevel 1\r\nTime: 10 us\r\n$ ");
+
+        output.clear();
+        type("time repeat 3 info\n");
+        CHECK(output == "time repeat 3 info\r\nTime: 30 us for 3 iterations (10 us each)\r\n$ ");
+
+        output.clear();
+        type("time\n");
+        CHECK(output == "time\r\nUsage: time <command>\r\n$ ");
+    }
+
+    SECTION("Test the chain continues when an asynchronous command is done")
+    {
+        MOCK_EXPECT(dump).exactly(4).calls([](Yash::CommandArgs, Yash::CommandState& state) { return state.step == 1; });
+        type("repeat 2 dump 1 && info\n");
+
+        for (size_t poll = 0; poll < 2; poll++) {
+            CHECK(yash.busy());
+            yash.poll();
+        }
+
+        MOCK_EXPECT(info).once();
+        yash.poll();
+        CHECK(!yash.busy());
+        CHECK(output == "repeat 2 dump 1 && info\r\n$ ");
+
+        MOCK_EXPECT(dump).once().calls([](Yash::CommandArgs, Yash::CommandState& state) {
+            state.status = Yash::Failure;
+            return true;
+        });
+        MOCK_EXPECT(info).once();
+        output.clear();
+        type("repeat 2 dump 1 || info\n");
+        CHECK(output == "repeat 2 dump 1 || info\r\nFailed in iteration 1\r\n$ ");
+    }
+
+    SECTION("Test Ctrl-C cancels the commands chained after an asynchronous command")
+    {
+        MOCK_EXPECT(dump).exactly(2).returns(false);
+        MOCK_EXPECT(info).never();
+
+        type("dump 1; info\n\x03");
+        CHECK(!yash.busy());
+        CHECK(yash.status() == Yash::Cancelled);
+        yash.poll();
+    }
+
+    SECTION("Test chained commands in a script")
+    {
+        MOCK_EXPECT(check).exactly(4).calls(checkValue);
+        MOCK_EXPECT(info).once();
+        MOCK_EXPECT(dump).exactly(2).calls([](Yash::CommandArgs, Yash::CommandState& state) { return state.step == 1; });
+
+        Yash::ScriptResult result = yash.runScript("check ok && dump 1 && info\ncheck fail || check ok\ncheck fail\n");
+        CHECK(result.commands == 6);
+        CHECK(result.failures == 1);
+        CHECK(result.failedLine == 3);
+    }
+}
+
+TEST_CASE("Yash statistics test")
+{
+    static constexpr Yash::Config config { .maxRequiredArgs = 3, .commandHistorySize = 10, .statisticsSize = 3 };
+    static constexpr auto commands = std::to_array<Yash::Command>({
+        Yash::statusCommand("check", "Check <value>", &check, 1),
+        Yash::asyncCommand("dump", "Flash dump <blocks>", &dump, 1),
+        { "info", "System info", &info, 0 },
+        { "reboot", "Reboot the system", &info, 0 },
+    });
+
+    std::string output;
+    Yash::Yash<config, StringSink> yash(commands, { &output });
+    yash.setPrompt("$ ");
+
+    auto type = [&yash](std::string_view characters) {
+        for (char character : characters)
+            yash.setCharacter(character);
+    };
+
+    SECTION("Test the calls and errors are counted without a clock")
+    {
+        MOCK_EXPECT(check).exactly(4).calls([](Yash::CommandArgs args) { return args[0] == "ok" ? Yash::Success : Yash::Failure; });
+        MOCK_EXPECT(info).exactly(2);
+        type("check ok; check fail; check\ninfo; reboot\nrepeat 2 check ok\n");
+
+        std::span<const Yash::CommandStatistics> statistics = yash.statistics();
+        REQUIRE(statistics.size() == 3);
+        CHECK(statistics[0].calls == 5);
+        CHECK(statistics[0].errors == 2);
+        CHECK(statistics[1].calls == 0);
+        CHECK(statistics[2].calls == 1);
+        CHECK(statistics[2].latency == std::array<uint32_t, Yash::CommandStatistics::s_latencyBuckets> {});
+
+        // The commands following the statisticsSize are not counted
+        output.clear();
+        type("stats\n");
+        CHECK(output == "stats\r\ncheck  5 calls, 2 errors\r\ninfo   1 calls, 0 errors\r\n$ ");
+
+        type("stats reset\n");
+        CHECK(yash.statistics()[0].calls == 0);
+
+        output.clear();
+        type("stats foo\n");
+        CHECK(yash.status() == Yash::InvalidArguments);
+        CHECK(output == "stats foo\r\nUsage: stats [reset]\r\n$ ");
+    }
+
+    SECTION("Test the latency of the calls is recorded with a clock")
+    {
+        yash.setClock(&clock);
+        MOCK_EXPECT(info).exactly(2);
+        MOCK_EXPECT(dump).exactly(4).calls([](Yash::CommandArgs, Yash::CommandState& state) {
+            state.status = state.step ? Yash::Success : Yash::Failure;
+            return true;
+        });
+
+        type("info; info\n");
+        type("dump 1\n");
+        yash.runScript("dump 1\ndump 1\ndump 1\n");
+
+        const Yash::CommandStatistics& statistics = yash.statistics()[2];
+        CHECK(statistics.calls == 2);
+        CHECK(statistics.latency[Yash::CommandStatistics::bucket(10)] == 2);
+        CHECK(yash.statistics()[1].errors == 4);
+
+        output.clear();
+        type("stats\n");
+        CHECK(output == "stats\r\ndump  4 calls, 4 errors, <16 us: 4\r\ninfo  2 calls, 0 errors, <16 us: 2\r\n$ ");
+    }
+
+    SECTION("Test the latency buckets")
+    {
+        CHECK(Yash::CommandStatistics::bucket(0) == 0);
+        CHECK(Yash::CommandStatistics::bucket(1) == 1);
+        CHECK(Yash::CommandStatistics::bucket(15) == 4);
+        CHECK(Yash::CommandStatistics::bucket(16) == 5);
+        CHECK(Yash::CommandStatistics::bucket(UINT64_MAX) == Yash::CommandStatistics::s_latencyBuckets - 1);
+    }
+}
+
+TEST_CASE("Yash RPC test")
+{
+    static constexpr Yash::Config config { .maxRequiredArgs = 3, .commandHistorySize = 10, .rpcFrameSize = 8 };
+    static constexpr auto commands = std::to_array<Yash::Command>({
+        Yash::statusCommand("check", "Check <value>", &check, 1),
+        Yash::asyncCommand("dump", "Flash dump <blocks>", &dump, 1),
+        { "info", "System info", &info, 0 },
+        Yash::command<&setLevel>("level", "Set the level"),
+    });
+
+    std::string output;
+    Yash::Yash<config, StringSink> yash(commands, { &output });
+    yash.setPrompt("$ ");
+
+    auto type = [&yash](std::string_view characters) {
+        for (char character : characters)
+            yash.setCharacter(character);
+    };
+
+    auto request = [&yash](uint8_t sequence, std::string_view payload) {
+        std::array<char, 128> frame;
+        size_t size = Yash::RpcFrame { sequence, 0, payload }.encode(frame);
+        REQUIRE(size == payload.size() + Yash::RpcFrame::s_overhead);
+        yash.feed({ frame.data(), size });
+    };
+
+    struct Response {
+        uint8_t sequence;
+        uint8_t status;
+        std::string payload;
+
+        bool operator==(const Response&) const = default;
+    };
+
+    // Decodes the response frames like a host
+    using Decoder = Yash::RpcDecoder<config.rpcFrameSize>;
+    auto responses = [&output]() {
+        std::vector<Response> frames;
+        Decoder decoder;
+        for (char character : output) {
+            Decoder::Result result = decoder.push(character);
+            CHECK(result != Decoder::Result::Invalid);
+            if (result == Decoder::Result::Frame)
+                frames.push_back({ decoder.frame().sequence, decoder.frame().status, std::string { decoder.frame().payload } });
+        }
+
+        output.clear();
+        return frames;
+    };
+
+    SECTION("Test the commands are run and their output is streamed in frames")
+    {
+        type(Yash::RpcFrame::s_magic);
+        CHECK(yash.rpcMode());
+        CHECK(output.empty());
+
+        request(1, "level 2");
+        CHECK(responses() == std::vector<Response> { { 1, Yash::Success, "level 2\n" } });
+
+        request(2, "level 12");
+        CHECK(responses() == std::vector<Response> { { 2, Yash::RpcOutput, "level 12" }, { 2, Yash::InvalidArguments, "\n" } });
+
+        request(3, "foo");
+        CHECK(responses() == std::vector<Response> { { 3, Yash::RpcOutput, "Command " }, { 3, Yash::RpcOutput, "not foun" }, { 3, Yash::NotFound, "d: foo\n" } });
+
+        MOCK_EXPECT(check).once().returns(Yash::Failure);
+        MOCK_EXPECT(info).once();
+        request(4, "check x || info");
+        CHECK(responses() == std::vector<Response> { { 4, Yash::Success, "" } });
+
+        // An empty request leaves the mode (where the input line was cleared)
+        request(5, "");
+        CHECK(output.substr(Yash::RpcFrame::s_overhead) == "$ ");
+        CHECK(responses() == std::vector<Response> { { 5, Yash::Success, "" } });
+        CHECK(!yash.rpcMode());
+        CHECK(yash.m_inputCommand.empty());
+    }
+
+    SECTION("Test invalid frames are answered and skipped")
+    {
+        REQUIRE(yash.enterRpcMode());
+
+        std::array<char, 128> frame;
+        size_t size = Yash::RpcFrame { 7, 0, "info" }.encode(frame);
+        frame[size - 1] ^= 1;
+        yash.feed({ frame.data(), size });
+        CHECK(responses() == std::vector<Response> { { 7, Yash::RpcInvalidFrame, "" } });
+
+        request(8, std::string(config.maxCommandLength + 1, 'x'));
+        CHECK(responses() == std::vector<Response> { { 8, Yash::RpcInvalidFrame, "" } });
+
+        MOCK_EXPECT(info).once();
+        request(9, "info");
+        CHECK(responses() == std::vector<Response> { { 9, Yash::Success, "" } });
+
+        yash.exitRpcMode();
+        CHECK(output == "$ ");
+    }
+
+    SECTION("Test the decoder synchronizes with the next frame after a corrupted size")
+    {
+        REQUIRE(yash.enterRpcMode());
+
+        // A size larger than the payload swallows the start of the next frame
+        std::array<char, 128> frame;
+        size_t size = Yash::RpcFrame { 1, 0, "info" }.encode(frame);
+        frame[1] = 12;
+        yash.feed({ frame.data(), size });
+        request(2, "info");
+        CHECK(responses() == std::vector<Response> { { 1, Yash::RpcInvalidFrame, "" } });
+
+        // A size larger than the maxCommandLength is answered without waiting for the payload
+        size = Yash::RpcFrame { 3, 0, "info" }.encode(frame);
+        frame[2] = 0x7f;
+        yash.feed({ frame.data(), Yash::RpcFrame::s_headerSize });
+        CHECK(responses() == std::vector<Response> { { 3, Yash::RpcInvalidFrame, "" } });
+
+        // The rest of the invalid frame and the characters between frames are skipped
+        MOCK_EXPECT(info).once();
+        yash.feed({ frame.data() + Yash::RpcFrame::s_headerSize, size - Yash::RpcFrame::s_headerSize });
+        yash.feed("\r\n");
+        request(4, "info");
+        CHECK(responses() == std::vector<Response> { { 4, Yash::Success, "" } });
+    }
+
+    SECTION("Test statuses which do not fit in a frame are reported as a failure")
+    {
+        REQUIRE(yash.enterRpcMode());
+
+        MOCK_EXPECT(check).exactly(5).calls([](Yash::CommandArgs args) { return std::stoi(std::string { args[0] }); });
+        request(1, "check 252");
+        request(2, "check 253");
+        request(3, "check 255");
+        request(4, "check 256");
+        request(5, "check -1");
+        CHECK(responses() == std::vector<Response> { { 1, 252, "" }, { 2, Yash::RpcFailure, "" }, { 3, Yash::RpcFailure, "" }, { 4, Yash::RpcFailure, "" }, { 5, Yash::RpcFailure, "" } });
+        CHECK(yash.status() == -1); // the status of the shell is not mapped
+    }
+
+    SECTION("Test asynchronous commands are stepped until they are done")
+    {
+        MOCK_EXPECT(dump).exactly(2).calls([](Yash::CommandArgs, Yash::CommandState& state) {
+            state.output.format("block {}\n", state.step);
+            return state.step == 1;
+        });
+
+        REQUIRE(yash.enterRpcMode());
+        request(1, "dump 1");
+        CHECK(responses() == std::vector<Response> { { 1, Yash::RpcOutput, "block 0\n" }, { 1, Yash::Success, "block 1\n" } });
+        CHECK(!yash.busy());
+    }
+
+    SECTION("Test the characters of a partial magic sequence are handled")
+    {
+        MOCK_EXPECT(info).once();
+        type("i\x16nfo\n");
+        CHECK(output == "info\r\n$ ");
+
+        // The held characters are echoed as soon as the sequence is broken
+        output.clear();
+        type("\x16YE");
+        CHECK(output == "YE");
+        type("\n");
+        CHECK(!yash.rpcMode());
+        CHECK(output.starts_with("YE\r\n"));
+    }
+
+    SECTION("Test the magic sequence is only matched at the start of a line")
+    {
+        type("inf");
+        output.clear();
+        type(Yash::RpcFrame::s_magic.substr(0, 5));
+        CHECK(output == "YASH");
+        CHECK(yash.m_inputCommand == "infYASH");
+
+        type(Yash::RpcFrame::s_magic.substr(5));
+        CHECK(!yash.rpcMode());
+    }
+}
+
+TEST_CASE("Yash transmit queue test")
+{
+    static constexpr auto commands = std::to_array<Yash::Command>({
+        { "info", "System info", &info, 0 },
+        Yash::command<&setLevel>("level", "Set the level"),
+    });
+
+    std::string output;
+    size_t budget { 0 };
+
+    auto type = [](auto& yash, std::string_view characters) {
+        for (char character : characters)
+            yash.setCharacter(character);
+    };
+
+    // The output of a shell with a blocking sink
+    std::string reference;
+    {
+        static constexpr Yash::Config config { .maxRequiredArgs = 3, .commandHistorySize = 10 };
+        Yash::Yash<config, StringSink> yash(commands, { &reference });
+        yash.setPrompt("$ ");
+        type(yash, "level 1\nlevel 2\n");
+    }
+
+    std::string_view firstCommand { reference.data(), reference.find("level 2") };
+
+    SECTION("Test the output not accepted is queued and written when the sink is ready")
+    {
+        static constexpr Yash::Config config { .maxRequiredArgs = 3, .commandHistorySize = 10, .txQueueSize = 256 };
+        Yash::Yash<config, LimitedSink> yash(commands, { &output, &budget });
+        yash.setPrompt("$ ");
+
+        budget = 4;
+        type(yash, "level 1\n");
+        CHECK(output == "leve");
+        CHECK(yash.txQueued() == firstCommand.size() - 4);
+
+        budget = SIZE_MAX;
+        yash.txReady();
+        CHECK(output == firstCommand);
+        CHECK(yash.txQueued() == 0);
+    }
+
+    SECTION("Test the input is paused above the high-water mark")
+    {
+        static constexpr Yash::Config config { .maxRequiredArgs = 3, .commandHistorySize = 10, .txQueueSize = 32, .txHighWater = 8 };
+        Yash::Yash<config, LimitedSink> yash(commands, { &output, &budget });
+        yash.setPrompt("$ ");
+
+        type(yash, "level 1\nlevel 2\n");
+        CHECK(output.empty());
+        CHECK(yash.txPaused());
+        CHECK(yash.txQueued() == firstCommand.size());
+
+        // The input typed ahead is handled like a burst of characters
+        budget = SIZE_MAX;
+        yash.txReady();
+        CHECK(!yash.txPaused());
+        CHECK(output.starts_with(firstCommand));
+        CHECK(output.ends_with("$ level 2\r\nlevel 2\r\n$ "));
+    }
+
+    SECTION("Test the overflowing output is dropped")
+    {
+        static constexpr Yash::Config config { .maxRequiredArgs = 3, .commandHistorySize = 10, .txQueueSize = 8, .txHighWater = 8, .txOverflow = Yash::TxOverflow::Drop };
+        Yash::Yash<config, LimitedSink> yash(commands, { &output, &budget });
+        yash.setPrompt("$ ");
+
+        type(yash, "level 1\n");
+        CHECK(yash.txDropped() == firstCommand.size() - 8);
+
+        budget = SIZE_MAX;
+        yash.txReady();
+        CHECK(output == firstCommand.substr(0, 8));
+    }
+
+    SECTION("Test the overflowing output is truncated with a marker")
+    {
+        static constexpr Yash::Config config { .maxRequiredArgs = 3, .commandHistorySize = 10, .txQueueSize = 16, .txHighWater = 16, .txOverflow = Yash::TxOverflow::Truncate };
+        Yash::Yash<config, LimitedSink> yash(commands, { &output, &budget });
+        yash.setPrompt("$ ");
+
+        type(yash, "level 1\n");
+        CHECK(yash.txDropped() == firstCommand.size() - 11);
+
+        budget = SIZE_MAX;
+        yash.txReady();
+        CHECK(output == std::string { firstCommand.substr(0, 11) } + "...\r\n");
+
+        // The output is queued again when the queue has been emptied
+        output.clear();
+        type(yash, "level 2\n");
+        CHECK(output == reference.substr(firstCommand.size()));
+    }
+
+    SECTION("Test the sink is called until the overflowing output fits")
+    {
+        static constexpr Yash::Config config { .maxRequiredArgs = 3, .commandHistorySize = 10, .txQueueSize = 8, .txHighWater = 8 };
+        Yash::Yash<config, LimitedSink> yash(commands, { &output, &budget, 3 });
+        yash.setPrompt("$ ");
+
+        budget = SIZE_MAX;
+        type(yash, "level 1\nlevel 2\n");
+        while (yash.txQueued())
+            yash.txReady();
+        CHECK(output == reference);
+        CHECK(yash.txDropped() == 0);
+    }
+}